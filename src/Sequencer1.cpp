@@ -1,6 +1,9 @@
 #include "plugin.hpp"
 #include "util.hpp"
 #include "cvRange.hpp"
+#include "coreAdapter.hpp"
+#include "profile.hpp"
+#include "rtcheck.hpp"
 
 #define MAX_SEQ_LENGTH 16
 
@@ -39,26 +42,23 @@ struct Sequencer1 : Module {
 
 	//Persistant State
 
-	int currentStep;
-	int currentBeat;
-	int currentEvolvedStep;
-	int currentDur;
-	bool muted;
-	bool ratcheting;
-	int cyclesToEvolve;
-	int evolutionCount;
-	bool evolvingUp;
-	int evolutionMapping [MAX_SEQ_LENGTH];
-	float evolutionRatcheting [MAX_SEQ_LENGTH];
-	bool evolveDur;
+	EvolvingStepSequencer seq;
 
 	//Non Persistant State
 
-	bool clockHigh = false;
-	bool resetHigh = false;
-
 	CVRange range = Bipolar_3;
 
+#ifdef JPLAB_PROFILE
+	enum ProfilePhase{
+		PROFILE_RESET,
+		PROFILE_CLOCK,
+		PROFILE_EVOLVE,
+		PROFILE_OUTPUTS,
+		PROFILE_LIGHTS,
+	};
+	Profiler profiler{std::vector<const char*>{"Reset", "Clock", "Evolve", "Outputs", "Lights"}};
+#endif
+
 	Sequencer1() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 
@@ -95,171 +95,80 @@ struct Sequencer1 : Module {
 
 	void initalize(){
 		range = Bipolar_3;
-		clockHigh = false;
+		seq.clockHigh = false;
+		seq.reset.initalize();
+		seq.reset.mode = RESET_IMMEDIATE;
+		seq.reset.window = 0;
+		seq.rng.seed(random::u64(), random::u64());
+		seq.initalize();
+	}
 
-		currentStep = -1;
-		currentBeat = -1;
-		currentEvolvedStep = -1;
-		currentDur = 0;
+	json_t *dataToJson() override{
+		json_t *jobj = json_object();
+		json_object_set_new(jobj, "reset", json_resetScheduler(seq.reset));
+		return jobj;
+	}
 
-		muted = false;
-		ratcheting = false;
+	void dataFromJson(json_t *jobj) override {
+		json_resetScheduler_value(json_object_get(jobj, "reset"), seq.reset);
+	}
 
-		cyclesToEvolve = 0;
-		evolutionCount = 0;
-		evolvingUp = true;
-		evolveDur = false;
-		for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
-			evolutionMapping[ni] = -1;
-			evolutionRatcheting[ni] = 0;
-		}
+	void readPattern(StepPattern & pattern){
+		readStepPattern(this, MAIN_SEQ_DURATION_PARAM, SEQ_LENGTH_PARAM, pattern);
+		pattern.lengthInSteps = params[LENGTH_MODE_PARAM].getValue() == 1;
+		pattern.evolutionLength = params[EVOLUTION_LENGTH_PARAM].getValue();
+		pattern.cyclesPerEvolution = params[CYCLES_PER_EVOLUTION_PARAM].getValue();
+		pattern.durationEvolutionChance = params[DURATION_EVOLUTION_CHANCE_PARAM].getValue();
+		pattern.fullLengthEvolution = params[FULL_LENGTH_EVOLUTION_PARAM].getValue() == 1;
+		pattern.instantDeevolution = params[DEEVOLUTION_MODE_PARAM].getValue() == 1;
+		pattern.ratchetChance = params[RATCHET_CHANCE_PARAM].getValue();
 	}
 
 	void process(const ProcessArgs& args) override {
-		//Reset Logic
-		if(schmittTrigger(resetHigh,inputs[RESET_INPUT].getVoltage())){
-			currentStep = -1;
-			currentBeat = -1;
-			currentEvolvedStep = -1;
-			currentDur = 0;
-
-			muted = false;
-			ratcheting = false;
-
-			cyclesToEvolve = 0;
-			evolutionCount = 0;
-			evolvingUp = true;
-			evolveDur = false;
-			for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
-				evolutionMapping[ni] = -1;
-				evolutionRatcheting[ni] = 0;
-			}
-		}
+		RTCHECK_SCOPE();
+		PROFILE_BEGIN(profiler);
 
-		//Clock Logic
-		if(schmittTrigger(clockHigh,inputs[CLOCK_INPUT].getVoltage())){
-			int maxStep = params[SEQ_LENGTH_PARAM].getValue();
-
-			bool maxStepInBeats = params[LENGTH_MODE_PARAM].getValue() == 0;
-
-			bool resetCycle = false;
-			bool doNextStep = false;
-
-			currentBeat++;
-			if(maxStepInBeats){
-				if(currentBeat >= maxStep) resetCycle = true;	
-			}
+		PROFILE_PHASE(profiler, PROFILE_RESET);
+		bool clock = seq.tick(inputs[CLOCK_INPUT].getVoltage(), inputs[RESET_INPUT].getVoltage(), args.sampleTime);
 
-			if(currentDur > 1){
-				currentDur--;
-			}else{
-				currentStep++;	
-				doNextStep = true;
-				if(!maxStepInBeats){
-					if(currentStep >= maxStep/4) resetCycle = true;
-				}
-			}					
-
-			if(resetCycle){
-				int maxStepReached = currentStep;
-				currentStep = 0;
-				currentBeat = 0;
-
-				evolveDur = rack::random::uniform() < params[DURATION_EVOLUTION_CHANCE_PARAM].getValue();
-
-				if(cyclesToEvolve > 1){
-					cyclesToEvolve --;
-				}else{
-					cyclesToEvolve = params[CYCLES_PER_EVOLUTION_PARAM].getValue();
-					int maxEvolution = params[EVOLUTION_LENGTH_PARAM].getValue();
-					if(evolutionCount >= maxEvolution){
-						evolvingUp = false;
-					}else if(evolutionCount <= 0){
-						evolvingUp = true;
-					}
-					
-					if(evolvingUp && evolutionCount < maxEvolution){
-						evolutionCount++;
-						std::vector<int> indexes;
-						for(int ni = 0; ni < maxStepReached; ni++){
-							if(evolutionMapping[ni] == -1) indexes.push_back(ni);
-						}
-						if(indexes.size() > 0){
-							int index = indexes[std::floor(rack::random::uniform() * indexes.size())];
-							bool fullLength = params[FULL_LENGTH_EVOLUTION_PARAM].getValue() == 1;
-							int maxRnd = fullLength ? MAX_SEQ_LENGTH : maxStepReached;
-							evolutionMapping[index] = std::floor(rack::random::uniform() * maxRnd);
-							evolutionRatcheting[index] = rack::random::uniform(); 
-						}
-					}else if(evolutionCount > 0){
-						if(params[DEEVOLUTION_MODE_PARAM].getValue() == 1){
-							//Instant De-evolve
-							cyclesToEvolve = 0;
-							evolutionCount = 0;
-							evolvingUp = true;
-							evolveDur = false;
-							for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
-								evolutionMapping[ni] = -1;
-								evolutionRatcheting[ni] = 0;
-							}
-						}else{
-							//Slow De-evolve
-							evolutionCount--;
-							if(evolutionCount <= maxStepReached){
-								std::vector<int> indexes;
-								for(int ni = 0; ni < maxStepReached; ni++){
-									if(evolutionMapping[ni] != -1) indexes.push_back(ni);
-								}
-								if(indexes.size() > 0){
-									int index = indexes[std::floor(rack::random::uniform() * indexes.size())];
-									evolutionMapping[index] = -1;
-								}
-							}
-						}
-					}
-				}
-			}
-
-			if(doNextStep){
-				currentEvolvedStep = evolutionMapping[currentStep % MAX_SEQ_LENGTH];
-				float ratchetRnd = evolutionRatcheting[currentStep % MAX_SEQ_LENGTH];
-				if(currentEvolvedStep == -1){
-					currentEvolvedStep = currentStep % MAX_SEQ_LENGTH;
-					ratcheting = false;
-				}else{
-					ratcheting = ratchetRnd < params[RATCHET_CHANCE_PARAM].getValue();
-				}
-
-				//Use Duration from Current Step
-				int dur = params[MAIN_SEQ_DURATION_PARAM + (evolveDur ? currentEvolvedStep : currentStep)].getValue();
-				muted = dur <= 0;
-				if(muted) dur = -dur + 1;
-				currentDur = dur;
+		//Clock Logic
+		PROFILE_PHASE(profiler, PROFILE_CLOCK);
+		if(clock){
+			StepPattern pattern;
+			readPattern(pattern);
+			if(seq.nextBeat(pattern)){
+				PROFILE_SCOPE(profiler, PROFILE_EVOLVE); //Also counted in Clock
+				seq.evolve(pattern);
 			}
+			seq.startStep(pattern);
 		}
 
 		//Update Outputs
-		if(muted){
-			//CV Holds Value
-			outputs[GATE_OUTPUT].setVoltage(0);
-		}else{
-			float val = params[MAIN_SEQ_NOTE_CV_PARAM + currentEvolvedStep].getValue();
-			float cv = mapCVRange(val,range);
-			outputs[CV_OUTPUT].setVoltage(cv);
-			outputs[GATE_OUTPUT].setVoltage((clockHigh || (!ratcheting && currentDur > 1)) ? 10 : 0);
+		PROFILE_PHASE(profiler, PROFILE_OUTPUTS);
+		int step = seq.outputStep();
+		if(step >= 0){
+			float val = params[MAIN_SEQ_NOTE_CV_PARAM + step].getValue();
+			outputs[CV_OUTPUT].setVoltage(mapCVRange(val,range));
 		}
+		//CV Holds Value while muted
+		outputs[GATE_OUTPUT].setVoltage(seq.gateHigh() ? 10 : 0);
 
 		//Update Lights
+		PROFILE_PHASE(profiler, PROFILE_LIGHTS);
 		for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
-			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 0].setBrightness((evolutionMapping[ni] != -1 && currentStep == ni) ? 1 : 0);
-			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 1].setBrightness((evolutionMapping[ni] != -1)? 1 : 0);
-			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 2].setBrightness((currentStep == ni || currentEvolvedStep == ni) ? 1 : 0);
+			bool evolved = seq.evolutionMapping[ni] != -1;
+			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 0].setBrightness((evolved && seq.currentStep == ni) ? 1 : 0);
+			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 1].setBrightness(evolved ? 1 : 0);
+			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 2].setBrightness((seq.currentStep == ni || seq.currentEvolvedStep == ni) ? 1 : 0);
 		}
 	}
 };
 
 
 struct Sequencer1Widget : ModuleWidget {
+#ifdef JPLAB_PROFILE
+	ProfileOverlay* profileOverlay;
+#endif
 	Sequencer1Widget(Sequencer1* module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/Blank26hp.svg")));
@@ -319,6 +228,14 @@ struct Sequencer1Widget : ModuleWidget {
 				x += dx * 3;
 			}
 		}
+
+#ifdef JPLAB_PROFILE
+		profileOverlay = createWidget<ProfileOverlay>(Vec(0,0));
+		profileOverlay->box.size = Vec(box.size.x, RACK_GRID_WIDTH * 10);
+		profileOverlay->profiler = module ? &module->profiler : NULL;
+		profileOverlay->hide();
+		addChild(profileOverlay);
+#endif
 	}
 
 	void appendContextMenu(Menu* menu) override {
@@ -328,6 +245,11 @@ struct Sequencer1Widget : ModuleWidget {
 		menu->addChild(createMenuLabel("Sequencer1"));
 		
 		addRangeSelectMenu<Sequencer1>(module,menu);
+		addResetMenu(menu, &module->seq.reset);
+
+#ifdef JPLAB_PROFILE
+		addProfileMenu(menu, &module->profiler, profileOverlay);
+#endif
 	}
 };
 
@@ -1,6 +1,9 @@
 #include "plugin.hpp"
 #include "util.hpp"
 #include "cvRange.hpp"
+#include "coreAdapter.hpp"
+#include "profile.hpp"
+#include "rtcheck.hpp"
 
 #define MAX_SEQ_LENGTH 16
 
@@ -34,21 +37,22 @@ struct Sequencer2 : Module {
 
 	//Persistant State
 
-	int currentStep;
-	int currentStepRegrograde;
-	int currentBeat;
-	int currentDur;
-	bool muted;
+	RetrogradeStepSequencer seq;
 
 	//Non Persistant State
 
-	bool clockHigh = false;
-	bool resetHigh = false;
-	bool retrogradeHigh = false;
-	bool inversionHigh = false;
-
 	CVRange range = Bipolar_3;
 
+#ifdef JPLAB_PROFILE
+	enum ProfilePhase{
+		PROFILE_RESET,
+		PROFILE_CLOCK,
+		PROFILE_OUTPUTS,
+		PROFILE_LIGHTS,
+	};
+	Profiler profiler{std::vector<const char*>{"Reset", "Clock", "Outputs", "Lights"}};
+#endif
+
 	Sequencer2() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 
@@ -80,110 +84,66 @@ struct Sequencer2 : Module {
 
 	void initalize(){
 		range = Bipolar_3;
-		clockHigh = false;
-		resetHigh = false;
-
-		retrogradeHigh = false;
-		inversionHigh = false;
-
+		seq.clockHigh = false;
+		seq.retrogradeHigh = false;
+		seq.inversionHigh = false;
+		seq.reset.initalize();
+		seq.reset.mode = RESET_IMMEDIATE;
+		seq.reset.window = 0;
+		seq.initalize();
+	}
 
-		currentStep = -1;
-		currentStepRegrograde = -1;
-		currentBeat = -1;
-		currentDur = 0;
+	json_t *dataToJson() override{
+		json_t *jobj = json_object();
+		json_object_set_new(jobj, "reset", json_resetScheduler(seq.reset));
+		return jobj;
+	}
 
-		muted = false;
+	void dataFromJson(json_t *jobj) override {
+		json_resetScheduler_value(json_object_get(jobj, "reset"), seq.reset);
 	}
 
 	void process(const ProcessArgs& args) override {
-		//Reset Logic
-		if(schmittTrigger(resetHigh,inputs[RESET_INPUT].getVoltage())){
-			currentStep = -1;
-			currentStepRegrograde = countSteps() - 1;
-			currentBeat = -1;
-			currentDur = 0;
-			muted = false;
-		}
+		RTCHECK_SCOPE();
+		PROFILE_BEGIN(profiler);
 
-		//Clock Logic
-		if(schmittTrigger(clockHigh,inputs[CLOCK_INPUT].getVoltage())){
-			int maxStep = params[SEQ_LENGTH_PARAM].getValue();
-
-			bool resetCycle = false;
-			bool doNextStep = false;
-
-			currentBeat++;
-			if(currentBeat >= maxStep) resetCycle = true;	
-
-			if(currentDur > 1){
-				currentDur--;
-			}else{
-				doNextStep = true;
-				currentStep++;
-				currentStepRegrograde--;
-			}					
-
-			if(resetCycle){
-				currentStep = 0;
-				currentStepRegrograde = countSteps() - 1;
-				currentBeat = 0;
-			}
+		PROFILE_PHASE(profiler, PROFILE_RESET);
+		bool due = seq.tick(inputs[CLOCK_INPUT].getVoltage(), inputs[RESET_INPUT].getVoltage(),
+			inputs[RETROGRADE_INPUT].getVoltage(), inputs[INVERSION_INPUT].getVoltage(), args.sampleTime);
 
-			if(doNextStep){
-				//Use Duration from Current Step
-				int dur = params[MAIN_SEQ_DURATION_PARAM + currentStep].getValue();
-				muted = dur <= 0;
-				if(muted) dur = -dur + 1;
-				currentDur = dur;
-			}
+		//Clock Logic
+		PROFILE_PHASE(profiler, PROFILE_CLOCK);
+		if(due){
+			StepPattern pattern;
+			readStepPattern(this, MAIN_SEQ_DURATION_PARAM, SEQ_LENGTH_PARAM, pattern);
+			seq.advance(pattern);
 		}
 
-		schmittTrigger(retrogradeHigh,inputs[RETROGRADE_INPUT].getVoltage());
-		schmittTrigger(inversionHigh,inputs[INVERSION_INPUT].getVoltage());
-
 		//Update Outputs
-		if(muted){
-			//CV Holds Value
-			outputs[GATE_OUTPUT].setVoltage(0);
-		}else{
-			float val = 0;
-			int stepIndex = retrogradeHigh ? currentStepRegrograde : currentStep;
-			if(stepIndex >= 0 && stepIndex < MAX_SEQ_LENGTH){ 
-				val = params[MAIN_SEQ_NOTE_CV_PARAM + stepIndex].getValue();
-			}
-			if(inversionHigh){
-				float root = params[MAIN_SEQ_NOTE_CV_PARAM].getValue();
-				float delta = val - root;
-				val = root - delta;
-			}
-			float cv = mapCVRange(val,range);
-			outputs[CV_OUTPUT].setVoltage(cv);
-			outputs[GATE_OUTPUT].setVoltage((clockHigh || currentDur > 1) ? 10 : 0);
+		PROFILE_PHASE(profiler, PROFILE_OUTPUTS);
+		if(!seq.muted){
+			int step = seq.outputStep();
+			float val = step >= 0 ? params[MAIN_SEQ_NOTE_CV_PARAM + step].getValue() : 0;
+			val = seq.transform(val, params[MAIN_SEQ_NOTE_CV_PARAM].getValue());
+			outputs[CV_OUTPUT].setVoltage(mapCVRange(val,range));
 		}
+		//CV Holds Value while muted
+		outputs[GATE_OUTPUT].setVoltage(seq.gateHigh() ? 10 : 0);
 
 		//Update Lights
+		PROFILE_PHASE(profiler, PROFILE_LIGHTS);
 		for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
-			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 0].setBrightness(retrogradeHigh && currentStepRegrograde == ni ? 1 : 0);
-			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 2].setBrightness(currentStep == ni ? 1 : 0);
+			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 0].setBrightness(seq.retrogradeHigh && seq.currentStepRetrograde == ni ? 1 : 0);
+			lights[MAIN_SEQ_ACTIVE_LIGHT + ni * 3 + 2].setBrightness(seq.currentStep == ni ? 1 : 0);
 		}
 	}
-
-	int countSteps(){
-		int maxBeats = params[SEQ_LENGTH_PARAM].getValue();
-		int step = 0;
-		while(maxBeats > 0){
-			int dur = params[MAIN_SEQ_DURATION_PARAM + step].getValue();
-			muted = dur <= 0;
-			if(muted) dur = -dur + 1;
-			maxBeats-=dur;
-			step++;
-		}
-		return step;
-	}
 };
 
 
 struct Sequencer2Widget : ModuleWidget {
+#ifdef JPLAB_PROFILE
+	ProfileOverlay* profileOverlay;
+#endif
 	Sequencer2Widget(Sequencer2* module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/Blank26hp.svg")));
@@ -232,6 +192,14 @@ struct Sequencer2Widget : ModuleWidget {
 				x += dx * 3;
 			}
 		}
+
+#ifdef JPLAB_PROFILE
+		profileOverlay = createWidget<ProfileOverlay>(Vec(0,0));
+		profileOverlay->box.size = Vec(box.size.x, RACK_GRID_WIDTH * 10);
+		profileOverlay->profiler = module ? &module->profiler : NULL;
+		profileOverlay->hide();
+		addChild(profileOverlay);
+#endif
 	}
 
 	void appendContextMenu(Menu* menu) override {
@@ -241,6 +209,11 @@ struct Sequencer2Widget : ModuleWidget {
 		menu->addChild(createMenuLabel("Sequencer2"));
 		
 		addRangeSelectMenu<Sequencer2>(module,menu);
+		addResetMenu(menu, &module->seq.reset);
+
+#ifdef JPLAB_PROFILE
+		addProfileMenu(menu, &module->profiler, profileOverlay);
+#endif
 	}
 };
 
@@ -1,7 +1,12 @@
 #include "plugin.hpp"
 #include "util.hpp"
 #include "widgets.hpp"
-#include "scales.hpp"
+#include "coreAdapter.hpp"
+#include "core/scales.hpp"
+#include "core/sequencer.hpp"
+#include "profile.hpp"
+#include "rtcheck.hpp"
+#include <osdialog.h>
 
 #define ROW_COUNT 2
 #define COL_COUNT 8
@@ -11,16 +16,44 @@
 #define MAX_NOTE_DUR 4
 #define DEFAULT_NOTE_DUR 2
 
+#define CHAIN_SEND_INTERVAL 1024 //Samples between block updates from a follower while the chain is stopped
+
+//Expander chain. The leftmost of adjacent Sequencer3s runs the clock and plays the playing blocks of every module
+//as one sequence, the others follow it. Messages go through Rack's double buffered expander slots.
+
+//Sent right every sample, each follower passes it on one position further
+struct ChainPlayheadMessage{
+	bool chained = false; //False when the sender plays alone
+	int position = 0; //Of the receiver, the first follower is 1
+	int pulse = -1; //In the chain's blocks, -1 when stopped
+	int evolvedPulse = -1;
+	int blockStart [CHAIN_MAX_MODULES] = {}; //First chain block of each module
+	int blockCount [CHAIN_MAX_MODULES] = {};
+	float cv = 0;
+	float gate = 0;
+	bool clockHigh = false; //For note previews, followers have no clock of their own
+};
+
+//Sent left by followers once per pulse, with their own blocks first and then those from further right
+struct ChainBlocksMessage{
+	int moduleCount = 0;
+	int blockCount [CHAIN_MAX_MODULES - 1] = {};
+	NoteBlock blocks [CHAIN_MAX_MODULES - 1][CORE_MAX_BLOCKS];
+};
+
 struct Sequencer3 : Module, NotePreviewer {
 	enum ParamId {
 		ENUMS(NOTE_BLOCK_PARAM, MAX_SEQ_LENGTH * NOTE_BLOCK_PARAM_COUNT),
 		SEQ_LENGTH_PARAM,
 		EVOLUTION_ON_PARAM,
+		ENUMS(NOTE_TIMING_PARAM, MAX_SEQ_LENGTH * 4),
+		ENUMS(GROOVE_PARAM, GROOVE_STEPS),
 		PARAMS_LEN
 	};
 	enum InputId {
 		CLOCK_INPUT,
 		RESET_INPUT,	
+		BPM_INPUT,
 		INPUTS_LEN
 	};
 	enum OutputId {
@@ -35,33 +68,66 @@ struct Sequencer3 : Module, NotePreviewer {
 
 	//Persistant State
 
-	int clockCounter;
-	int clockLength;
-	int currentPulse;
-	int pulseCounter;
-	bool clockHigh;
-
-	int evolutionMapping [MAX_SEQ_LENGTH];
-	int randomEvolution [MAX_SEQ_LENGTH];
-	bool evolveUpOrDownBias;
+	NoteBlockSequencer seq;
 
 	float seqLengthScalar;
 
+	int grooveTemplate; //GrooveTemplateId, custom takes its offsets from GROOVE_PARAM
+
+	bool noteTrails; //Played notes leave a fading ring behind
+	bool pianoRoll; //Show the piano roll in place of the note blocks
+	bool blockHeatmap; //Tint the note blocks by how often they have played lately
+
 	//Non Persistant State
 	
-	bool resetHigh;
 	float previewNote;	
 
-	bool hasHadFirstClockHigh;	
-
-	int currentEvolvedPulse;
-	bool evolveOn;
+	//UI thread, the groove offsets last handed to seq
+	float stagedGrooveOffsets [GROOVE_STEPS] = {};
+	bool grooveDirty;
+
+	//Snapshot of the note block params, refreshed on each pulse
+	NoteBlockPattern pattern;
+
+	MarkovModel markovLibrary;
+	MarkovGenerator markov;
+
+	//Outputs once per pulse for the panel scope
+	ScopeRing scope;
+	bool scopeGateSeen = false;
+
+	//Expander chain
+	ChainPlayheadMessage playheadMessages [2];
+	ChainBlocksMessage blocksMessages [2];
+	bool chainLeader = false;
+	int chainModules = 1;
+	int chainBlockStart [CHAIN_MAX_MODULES] = {};
+	int chainBlockCount [CHAIN_MAX_MODULES] = {MAX_SEQ_LENGTH}; //Matches the block space evolution starts with
+	int chainLastPulse = -1; //Follower, the leader's pulse at the last block update
+	int chainSendCounter = 0;
+
+	//Playhead on this module's own blocks for the display, -1 while it is elsewhere in the chain
+	int displayPulse = -1;
+	int displayEvolvedPulse = -1;
+	bool displayRunning = false;
+	bool displayFollower = false; //Playing a chain leader's sequence, whose evolution isn't this module's
+	int heatBlocks = MAX_SEQ_LENGTH; //Blocks of seq.blockPulses that are this module's own
+
+#ifdef JPLAB_PROFILE
+	enum ProfilePhase{
+		PROFILE_CLOCK,
+		PROFILE_OUTPUTS,
+		PROFILE_EVOLVE,
+	};
+	Profiler profiler{std::vector<const char*>{"Clock", "Outputs", "Evolve"}};
+#endif
 
 	Sequencer3() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 
 		configInput(CLOCK_INPUT,"Clock");
 		configInput(RESET_INPUT,"Reset");
+		configInput(BPM_INPUT,"Start tempo (0V = 120 BPM, 1V/oct)");
 		configOutput(GATE_OUTPUT,"Gate");
 		configOutput(CV_OUTPUT,"CV");
 
@@ -73,144 +139,246 @@ struct Sequencer3 : Module, NotePreviewer {
 
 		for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){
 			configNoteBlock(this,NOTE_BLOCK_PARAM + ni * NOTE_BLOCK_PARAM_COUNT, ni == 0);
+			for(int i = 0; i < 4; i++){
+				//Shown as a percent of a sixteenth, which is 6 pulses
+				auto timingQ = configParam(NOTE_TIMING_PARAM + ni * 4 + i, -NOTE_TIMING_MAX, NOTE_TIMING_MAX, 0.f, "Timing", "% of a 16th", 0.f, 100.f / 6.f);
+				timingQ->randomizeEnabled = false;
+			}
 		}
+		for(int si = 0; si < GROOVE_STEPS; si++){
+			auto grooveQ = configParam(GROOVE_PARAM + si, -NOTE_TIMING_MAX, NOTE_TIMING_MAX, 0.f, string::f("Groove sixteenth %d", si + 1), "% of a 16th", 0.f, 100.f / 6.f);
+			grooveQ->randomizeEnabled = false;
+		}
+		seq.setSampleRate(APP->engine->getSampleRate());
+
+		leftExpander.producerMessage = &playheadMessages[0];
+		leftExpander.consumerMessage = &playheadMessages[1];
+		rightExpander.producerMessage = &blocksMessages[0];
+		rightExpander.consumerMessage = &blocksMessages[1];
 		initalize();
 	}
 
 	void onReset(const ResetEvent& e) override {
 		Module::onReset(e);
 		initalize();
+		updateGroove(true);
 	}
 
-	void initalize(){
-		hasHadFirstClockHigh = false;
-
-		clockHigh = false;
-		resetHigh = false;
+	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		Module::onSampleRateChange(e);
+		seq.setSampleRate(e.sampleRate);
+	}
 
-		clockCounter = 0;
-		clockLength = 0;
+	void initalize(){
+		seq.initalize();
+		seq.rng.seed(random::u64(), random::u64());
 
 		previewNote = NoteEntryWidget_OFF;
 
-		currentPulse = -1;
-		pulseCounter = 0;
-
 		seqLengthScalar = 1;
 
-		currentEvolvedPulse = -1;
-		evolveUpOrDownBias = true;
-		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
-			evolutionMapping[bi] = -1;
-			randomEvolution[bi] = -1;
+		seq.tempo.lockBeats = 0;
+		seq.tempo.outlierRatio = 0;
+		seq.clock.predictStart = false;
+		seq.reset.mode = RESET_IMMEDIATE;
+		seq.reset.window = 0;
+		seq.setPpqn(PULSES_PER_BLOCK);
+		grooveTemplate = GROOVE_OFF;
+		grooveDirty = true;
+		seq.gate = GateSettings();
+		noteTrails = false;
+		pianoRoll = false;
+		blockHeatmap = false;
+
+		setEvolutionMode(EM_RANDOM);
+		seq.genetic.setSettings(GeneticSettings());
+	}
+
+	//UI thread. Builds the groove map from the template and custom params when they change and hands it to the audio thread.
+	//Load and reset set it at once with now, the engine isn't processing then and the groove has to play without a UI.
+	void updateGroove(bool now = false){
+		float offsets [GROOVE_STEPS];
+		float custom [GROOVE_STEPS];
+		for(int si = 0; si < GROOVE_STEPS; si++){
+			custom[si] = params[GROOVE_PARAM + si].getValue();
+		}
+		grooveTemplateOffsets(grooveTemplate, custom, offsets);
+		for(int si = 0; si < GROOVE_STEPS; si++){
+			if(offsets[si] != stagedGrooveOffsets[si]) grooveDirty = true;
+		}
+		if(!grooveDirty) return;
+
+		GrooveMap map;
+		buildGrooveMap(offsets, map);
+		if(now) seq.setGroove(map);
+		if(now || seq.stageGroove(map)){
+			grooveDirty = false;
+			for(int si = 0; si < GROOVE_STEPS; si++){
+				stagedGrooveOffsets[si] = offsets[si];
+			}
 		}
 	}
 
+	void setEvolutionMode(EvolutionMode mode){
+		seq.setEvolutionMode(mode, random::u64());
+	}
+
 	json_t *dataToJson() override{
 		json_t *jobj = json_object();
 
-		json_object_set_new(jobj, "clockCounter", json_integer(clockCounter));
-		json_object_set_new(jobj, "clockLength", json_integer(clockLength));
-		json_object_set_new(jobj, "currentPulse", json_integer(currentPulse));
-		json_object_set_new(jobj, "pulseCounter", json_integer(pulseCounter));
-		json_object_set_new(jobj, "clockHigh", json_bool(clockHigh));
+		//Clock state is saved in seconds so the patch loads at any sample rate
+		json_object_set_new(jobj, "clockCounterTime", json_real(seq.clock.clockCounter / seq.sampleRate));
+		json_object_set_new(jobj, "clockLengthTime", json_real(seq.clock.clockLength / seq.sampleRate));
+		json_object_set_new(jobj, "currentPulse", json_integer(seq.currentPulse));
+		json_object_set_new(jobj, "pulseCounterTime", json_real(seq.pulses.pulseCounter / seq.sampleRate));
+		json_object_set_new(jobj, "clockHigh", json_bool(seq.clock.clockHigh));
+
+		json_object_set_new(jobj, "clockLockBeats", json_real(seq.tempo.lockBeats));
+		json_object_set_new(jobj, "clockOutlierRatio", json_real(seq.tempo.outlierRatio));
+		json_object_set_new(jobj, "predictStart", json_bool(seq.clock.predictStart));
+		json_object_set_new(jobj, "ppqn", json_integer(seq.requestedPpqn));
+		json_object_set_new(jobj, "grooveTemplate", json_integer(grooveTemplate));
+		json_object_set_new(jobj, "gate", json_gateSettings(seq.gate));
+		json_object_set_new(jobj, "noteTrails", json_bool(noteTrails));
+		json_object_set_new(jobj, "pianoRoll", json_bool(pianoRoll));
+		json_object_set_new(jobj, "blockHeatmap", json_bool(blockHeatmap));
+		json_object_set_new(jobj, "reset", json_resetScheduler(seq.reset));
+
+		json_object_set_new(jobj, "evolutionMode", json_integer(seq.getEvolutionMode()));
+		json_object_set_new(jobj, "genetic", json_geneticSettings(seq.genetic.getSettings()));
+
+		if(markovLibrary.patternsLearned > 0){
+			json_object_set_new(jobj, "markovLibrary", json_markovModel(markovLibrary));
+		}
 
 		return jobj;
 	}
 
 	void dataFromJson(json_t *jobj) override {		
 
-		clockCounter = json_integer_value(json_object_get(jobj, "clockCounter"));
-		clockLength = json_integer_value(json_object_get(jobj, "clockLength"));
-		currentPulse = json_integer_value(json_object_get(jobj, "currentPulse"));
-		pulseCounter = json_integer_value(json_object_get(jobj, "pulseCounter"));	
-		clockHigh = json_is_true(json_object_get(jobj, "clockHigh"));	
+		seq.clock.clockCounter = json_samples_value(jobj, "clockCounterTime", "clockCounter", seq.sampleRate);
+		seq.clock.clockLength = json_samples_value(jobj, "clockLengthTime", "clockLength", seq.sampleRate);
+		seq.currentPulse = json_integer_value(json_object_get(jobj, "currentPulse"));
+		seq.pulses.pulseCounter = json_samples_value(jobj, "pulseCounterTime", "pulseCounter", seq.sampleRate);
+		seq.clock.clockHigh = json_is_true(json_object_get(jobj, "clockHigh"));	
+
+		seq.tempo.lockBeats = json_number_value(json_object_get(jobj, "clockLockBeats"));
+		seq.tempo.outlierRatio = json_number_value(json_object_get(jobj, "clockOutlierRatio"));
+		seq.clock.predictStart = json_bool_value(json_object_get(jobj, "predictStart"));
+		json_t* ppqnJ = json_object_get(jobj, "ppqn");
+		seq.setPpqn(ppqnJ ? json_integer_value(ppqnJ) : PULSES_PER_BLOCK);
+		grooveTemplate = clamp((int) json_integer_value(json_object_get(jobj, "grooveTemplate")), 0, GROOVE_TEMPLATE_COUNT - 1);
+		grooveDirty = true;
+		updateGroove(true);
+		json_gateSettings_value(json_object_get(jobj, "gate"), seq.gate);
+		noteTrails = json_is_true(json_object_get(jobj, "noteTrails"));
+		pianoRoll = json_is_true(json_object_get(jobj, "pianoRoll"));
+		blockHeatmap = json_is_true(json_object_get(jobj, "blockHeatmap"));
+		json_resetScheduler_value(json_object_get(jobj, "reset"), seq.reset);
+
+		json_markovModel_value(json_object_get(jobj, "markovLibrary"), markovLibrary);
+
+		GeneticSettings geneticSettings;
+		json_geneticSettings_value(json_object_get(jobj, "genetic"), geneticSettings);
+		seq.genetic.setSettings(geneticSettings);
+		setEvolutionMode(static_cast<EvolutionMode>(json_integer_value(json_object_get(jobj, "evolutionMode"))));
 	}
 
-	void process(const ProcessArgs& args) override {
+	static bool isSequencer3(Module* module){
+		return module && module->model == modelSequencer3;
+	}
 
-		bool clockHighEvent = schmittTrigger(clockHigh,inputs[CLOCK_INPUT].getVoltage());	
-		if(clockHighEvent && !hasHadFirstClockHigh){
-			clockHighEvent = false;
-			hasHadFirstClockHigh = true;
-			clockCounter = 0;
-		}
-		countClockLength(clockCounter,clockLength,clockHighEvent);
+	//chainPulse relative to the blocks from start, -1 when outside them
+	static int localPulse(int chainPulse, int start, int count){
+		int pulse = chainPulse - start * PULSES_PER_BLOCK;
+		if(chainPulse < 0 || pulse < 0 || pulse >= count * PULSES_PER_BLOCK) return -1;
+		return pulse;
+	}
 
-		if(clockLength <= 0) return;
-		// DEBUG("clockLength:%i clockCounter:%i",clockLength,clockCounter);
+	void process(const ProcessArgs& args) override {
+		RTCHECK_SCOPE();
+		PROFILE_BEGIN(profiler);
 
-		bool pulseEvent = false;
-		if(pulseCounter > 0){
-			pulseCounter--;
-		}else{
-			pulseCounter = clockLength / 24; //Pulses are 24 Pulses per Quarter Note
-			pulseEvent = true;
+		const ChainPlayheadMessage* playhead = NULL;
+		if(isSequencer3(leftExpander.module)){
+			const ChainPlayheadMessage* message = (const ChainPlayheadMessage*) leftExpander.consumerMessage;
+			if(message->chained && message->position < CHAIN_MAX_MODULES) playhead = message;
 		}
 
-		
-		//Reset Logic
-		if(schmittTrigger(resetHigh,inputs[RESET_INPUT].getVoltage())){
-			currentPulse = -1;
-			pulseCounter = 0;
+		displayFollower = playhead != NULL;
+		if(playhead){
+			processFollower(*playhead);
+		}else{
+			chainLeader = isSequencer3(rightExpander.module);
+			processSequencer(args);
+			displayPulse = localPulse(seq.currentPulse, 0, heatBlocks);
+			displayEvolvedPulse = localPulse(seq.currentEvolvedPulse, 0, heatBlocks);
+			displayRunning = seq.isRunning();
 		}
+		sendChainPlayhead(playhead);
+	}
 
-
-		//Clock Logic
-		if(pulseEvent){
-			//Incremnt Pulse
-			currentPulse++;
-
-			bool _evolveOn = params[EVOLUTION_ON_PARAM].getValue() == 1;
-
-			if(evolveOn != _evolveOn){
-				evolveOn = _evolveOn;
-				if(evolveOn){
-					//Clear Evolution when the switch is turned on so we get a fresh run
-					for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
-						evolutionMapping[bi] = -1;
-						randomEvolution[bi] = -1;
-					}
+	void processSequencer(const ProcessArgs& args){
+		bool tickEvent;
+		{
+			PROFILE_SCOPE(profiler, PROFILE_CLOCK);
+			if(seq.clock.predictStart && seq.clock.waitingForStart()){
+				//With a BPM CV the start tempo comes from it, otherwise from the last measured period
+				seq.clock.predictedLength = 0;
+				if(inputs[BPM_INPUT].isConnected()){
+					float bpm = 120.f * powf(2.0f, inputs[BPM_INPUT].getVoltage());
+					seq.clock.predictedLength = clamp(args.sampleRate * 60.f / bpm, 1.f, args.sampleRate * 60.f);
 				}
 			}
+			tickEvent = seq.tick(inputs[CLOCK_INPUT].getVoltage(), inputs[RESET_INPUT].getVoltage(), args.sampleTime);
+		}
+		if(!seq.isRunning()){
+			//Stopped transport, don't leave a note hanging
+			if(seq.clock.predictStart) outputs[GATE_OUTPUT].setVoltage(0);
+			return;
+		}
 
-			int maxPulse = params[SEQ_LENGTH_PARAM].getValue() * seqLengthScalar * 24; //24 Pulses per Sixtenth Note			
-
-			//Wrap Pulse
-			if(currentPulse >= maxPulse){
-				currentPulse = 0;
-				if(evolveOn){
-					doEvolve();
+		//Clock Logic
+		if(tickEvent){
+			if(seq.nextTick()){
+				//The pulse that just ended, with any gate that came and went inside it
+				scope.push(outputs[CV_OUTPUT].getVoltage(), scopeGateSeen || outputs[GATE_OUTPUT].getVoltage() > 0);
+				scopeGateSeen = false;
+
+				//New pulse, the ticks in between only step through the timeline built here
+				int maxBlock = readChainPattern();
+				bool evolveOn = params[EVOLUTION_ON_PARAM].getValue() == 1;
+
+				if(seq.nextPulse(maxBlock, evolveOn)){
+					PROFILE_SCOPE(profiler, PROFILE_EVOLVE);
+					seq.evolve(pattern, maxBlock);
 				}
+				seq.buildTimeline(pattern);
 			}
 
-			float cv;
-			bool updateCV;
-			bool gateHigh;
-
-			int pulse = currentPulse;
-
-			if(evolveOn){
-				int block = pulse/24;
-				int pulseInBlock = pulse - block * 24;
-				int rndBlock = randomEvolution[block];
-				int evolvedBlock = evolutionMapping[block];
-				if(rndBlock != -1) block = rndBlock;
-				else if(evolvedBlock != -1)  block = evolvedBlock;
-				pulse = pulseInBlock + block * 24;
-				currentEvolvedPulse = currentPulse == pulse ? - 1 : pulse;
-			}else{
-				currentEvolvedPulse = -1;
+			NoteBlockOutput out;
+			bool outputChanged;
+			{
+				PROFILE_SCOPE(profiler, PROFILE_OUTPUTS);
+				outputChanged = seq.evaluateTick(out);
 			}
-
-			getOuputValues(this,NOTE_BLOCK_PARAM,pulse,cv,updateCV,gateHigh);
-			if(updateCV){
-				outputs[CV_OUTPUT].setVoltage(cv);
+			if(outputChanged){
+				if(out.updateCV){
+					outputs[CV_OUTPUT].setVoltage(out.cv);
+				}
+				outputs[GATE_OUTPUT].setVoltage(out.gateHigh ? 10 : 0);
+				scopeGateSeen = scopeGateSeen || out.gateHigh;
 			}
-			outputs[GATE_OUTPUT].setVoltage(gateHigh ? 10 : 0);		
 		}
+		if(seq.gateEnd()){
+			outputs[GATE_OUTPUT].setVoltage(0);
+		}
+
+		applyPreview(seq.clock.clockHigh);
+	}
 
-		//Overide Output when preview is high
+	//Overide Output when preview is high
+	void applyPreview(bool clockHigh){
 		if(previewNote != NoteEntryWidget_OFF){
 			//Preview Note
 			outputs[CV_OUTPUT].setVoltage(previewNote);
@@ -218,120 +386,142 @@ struct Sequencer3 : Module, NotePreviewer {
 		}
 	}
 
-	void doEvolve(){
-		using rack::random::uniform;
-
-		int maxBlock = params[SEQ_LENGTH_PARAM].getValue() * seqLengthScalar;
-
-		int evolvedBlocks = 0;
-		for(int bi = 0; bi < maxBlock; bi++){
-			if(evolutionMapping[bi] != -1) evolvedBlocks++;
+	//Fills pattern with the blocks to play and returns the sequence length. Leading a chain that is this module's
+	//playing blocks followed by each follower's, and evolution can map between all of them.
+	int readChainPattern(){
+		int start [CHAIN_MAX_MODULES] = {};
+		int count [CHAIN_MAX_MODULES] = {};
+		if(!chainLeader){
+			chainModules = 1;
+			heatBlocks = MAX_SEQ_LENGTH;
+			readNoteBlockPattern(this, NOTE_BLOCK_PARAM, MAX_SEQ_LENGTH, pattern, NOTE_TIMING_PARAM);
+			count[0] = MAX_SEQ_LENGTH;
+			setChainLayout(start, count);
+			return params[SEQ_LENGTH_PARAM].getValue() * seqLengthScalar;
 		}
-		float percentEvolved = evolvedBlocks / (float) maxBlock;
-
-		float evolveUpChance = 1 - percentEvolved;
-
-		DEBUG("percentEvolved:%f evolveUpChance:%f",percentEvolved,evolveUpChance);
 
-		//Temp Evolutions
-		{
-			//Mirror Chance
-			for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
-				randomEvolution[bi] = -1;
-				//Ranomd chance to ghost to the corresponding block on the other row
-				if(uniform() < 0.2){
-					randomEvolution[bi] = (bi + 8) % 16;
-				}
-			}
-			
-			//Random One-Time
-			{
-				//Randomly Map one to another temporarily
-				int x = rndInt(maxBlock);
-				int y = rndInt(MAX_SEQ_LENGTH);
-				randomEvolution[x] = y;
-				DEBUG("randomEvolution %i -> %i",x,y);
+		heatBlocks = playingBlockCount();
+		readNoteBlockPattern(this, NOTE_BLOCK_PARAM, heatBlocks, pattern, NOTE_TIMING_PARAM);
+		count[0] = heatBlocks;
+
+		const ChainBlocksMessage* message = (const ChainBlocksMessage*) rightExpander.consumerMessage;
+		chainModules = 1 + std::min(message->moduleCount, CHAIN_MAX_MODULES - 1);
+		for(int mi = 1; mi < CHAIN_MAX_MODULES; mi++){
+			start[mi] = pattern.blockCount;
+			if(mi >= chainModules) continue;
+			count[mi] = clamp(message->blockCount[mi - 1], 0, CORE_MAX_BLOCKS);
+			for(int bi = 0; bi < count[mi]; bi++){
+				pattern.blocks[pattern.blockCount++] = message->blocks[mi - 1][bi];
 			}
 		}
+		setChainLayout(start, count);
+		return pattern.blockCount;
+	}
 
-
-		//Semi-Permeanant Evolution Chance
-		if(uniform() < 0.5){
-
-			if(evolveUpOrDownBias){
-				//DnD Advantage
-				evolveUpChance = 1-evolveUpChance;
-				evolveUpChance = evolveUpChance * evolveUpChance;
-				evolveUpChance = 1-evolveUpChance;
-				DEBUG("Up/Advantage evolveUpChance:%f",evolveUpChance);
-			}else{
-				//DnD Disadvantage
-				evolveUpChance = evolveUpChance * evolveUpChance;
-				DEBUG("Down/Disadvantage evolveUpChance:%f",evolveUpChance);
-			}
-
-			if(uniform() < evolveUpChance){
-				addEvolution();
-			}else{
-				removeEvolution();
+	//Moves evolved mappings along with their blocks when a module of the chain changes length or leaves it,
+	//so only mappings from or to blocks that are gone are lost
+	void setChainLayout(const int* start, const int* count){
+		bool changed = false;
+		for(int mi = 0; mi < CHAIN_MAX_MODULES; mi++){
+			changed |= start[mi] != chainBlockStart[mi] || count[mi] != chainBlockCount[mi];
+		}
+		if(!changed) return;
+
+		int remap [CHAIN_MAX_BLOCKS];
+		for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++) remap[bi] = -1;
+		int blocks = 0;
+		for(int mi = 0; mi < CHAIN_MAX_MODULES; mi++){
+			for(int bi = 0; bi < std::min(count[mi], chainBlockCount[mi]); bi++){
+				remap[chainBlockStart[mi] + bi] = start[mi] + bi;
 			}
+			chainBlockStart[mi] = start[mi];
+			chainBlockCount[mi] = count[mi];
+			blocks += count[mi];
+		}
+		seq.evolution.setBlockSpace(blocks, remap);
+	}
 
-			if(percentEvolved > 0.8 && evolveUpOrDownBias){
-				evolveUpOrDownBias = false;
-			}else if(percentEvolved <= 0 && !evolveUpOrDownBias){
-				evolveUpOrDownBias = true;
+	//Plays the leader's outputs and shows where its playhead is on this module's blocks
+	void processFollower(const ChainPlayheadMessage & message){
+		chainLeader = false;
+		heatBlocks = MAX_SEQ_LENGTH;
+		outputs[CV_OUTPUT].setVoltage(message.cv);
+		outputs[GATE_OUTPUT].setVoltage(message.gate);
+
+		int start = message.blockStart[message.position];
+		int count = message.blockCount[message.position];
+		displayPulse = localPulse(message.pulse, start, count);
+		displayEvolvedPulse = localPulse(message.evolvedPulse, start, count);
+		displayRunning = message.pulse >= 0;
+
+		if(message.pulse != chainLastPulse){
+			chainLastPulse = message.pulse;
+			if(message.pulse >= 0){
+				scope.push(message.cv, message.gate > 0);
+				//Count the block that sounds, wherever the playhead borrowed it from
+				int sounding = localPulse(message.evolvedPulse >= 0 ? message.evolvedPulse : message.pulse, start, count);
+				if(sounding >= 0){
+					std::atomic<uint32_t> & counter = seq.blockPulses[sounding / PULSES_PER_BLOCK];
+					counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
 			}
+			sendChainBlocks(message.position);
+		}else if(++chainSendCounter >= CHAIN_SEND_INTERVAL){
+			//Stopped, keep the leader's copy fresh for when it starts
+			sendChainBlocks(message.position);
 		}
+		applyPreview(message.clockHigh);
 	}
 
-	void addEvolution(){
-		using rack::random::uniform;
+	void sendChainBlocks(int position){
+		chainSendCounter = 0;
+		Module* left = leftExpander.module;
+		ChainBlocksMessage* out = (ChainBlocksMessage*) left->rightExpander.producerMessage;
 
-		std::vector<int> indexes;
-		int maxBlock = params[SEQ_LENGTH_PARAM].getValue() * seqLengthScalar;
-		for(int bi = 0; bi < maxBlock; bi++){
-			if(evolutionMapping[bi] == -1) indexes.push_back(bi);
+		//pattern is free while following, so read into it
+		readNoteBlockPattern(this, NOTE_BLOCK_PARAM, playingBlockCount(), pattern, NOTE_TIMING_PARAM);
+		out->blockCount[0] = pattern.blockCount;
+		for(int bi = 0; bi < pattern.blockCount; bi++){
+			out->blocks[0][bi] = pattern.blocks[bi];
 		}
-		if(indexes.size() > 0){
-			int inBlock = indexes[rndInt(indexes.size())];
-			int outBlock = rndInt(MAX_SEQ_LENGTH);
-			evolutionMapping[inBlock] = outBlock;
-
-			//Chance to map a run of sequential blocks
-			while(uniform() < 0.5){
-				outBlock++;
-				if(outBlock >= MAX_SEQ_LENGTH) return;
-
-				inBlock++;
-				if(inBlock >= MAX_SEQ_LENGTH) return;
-				
-				//Note this allows mapping over existing evolutions
-
-				evolutionMapping[inBlock] = outBlock;
+		out->moduleCount = 1;
+
+		if(isSequencer3(rightExpander.module)){
+			const ChainBlocksMessage* in = (const ChainBlocksMessage*) rightExpander.consumerMessage;
+			int forwarded = std::min(in->moduleCount, CHAIN_MAX_MODULES - 1 - position);
+			for(int mi = 0; mi < forwarded; mi++){
+				out->blockCount[mi + 1] = in->blockCount[mi];
+				for(int bi = 0; bi < in->blockCount[mi]; bi++){
+					out->blocks[mi + 1][bi] = in->blocks[mi][bi];
+				}
 			}
+			out->moduleCount += std::max(forwarded, 0);
 		}
+		left->rightExpander.requestMessageFlip();
 	}
 
-	void removeEvolution(){
-		using rack::random::uniform;
-
-		std::vector<int> indexes;
-		int maxBlock = params[SEQ_LENGTH_PARAM].getValue();
-		for(int bi = 0; bi < maxBlock; bi++){
-			if(evolutionMapping[bi] != -1) indexes.push_back(bi);
-		}
-		if(indexes.size() > 0){
-			int inBlock = indexes[rndInt(indexes.size())];
-			evolutionMapping[inBlock] = -1;
-
-			//Chance to clear a run of sequential blocks
-			while(uniform() < 0.5){
-				inBlock++;
-				if(inBlock >= MAX_SEQ_LENGTH) return;
-
-				evolutionMapping[inBlock] = -1;
+	//Every sample, so a follower never acts on a stale playhead once the chain changes
+	void sendChainPlayhead(const ChainPlayheadMessage* in){
+		Module* right = rightExpander.module;
+		if(!isSequencer3(right)) return;
+		ChainPlayheadMessage* out = (ChainPlayheadMessage*) right->leftExpander.producerMessage;
+		if(in){
+			*out = *in;
+			out->position = in->position + 1;
+		}else{
+			out->chained = chainLeader;
+			out->position = 1;
+			out->pulse = seq.isRunning() ? seq.currentPulse : -1;
+			out->evolvedPulse = seq.currentEvolvedPulse;
+			for(int mi = 0; mi < CHAIN_MAX_MODULES; mi++){
+				out->blockStart[mi] = chainBlockStart[mi];
+				out->blockCount[mi] = chainBlockCount[mi];
 			}
+			out->cv = outputs[CV_OUTPUT].getVoltage();
+			out->gate = outputs[GATE_OUTPUT].getVoltage();
+			out->clockHigh = seq.clock.clockHigh;
 		}
+		right->leftExpander.requestMessageFlip();
 	}
 
 	void setPreviewNote(float note) override{
@@ -343,8 +533,11 @@ struct Sequencer3 : Module, NotePreviewer {
 
 		using rack::random::uniform;
 
-		randomizeCVs();
-		randomizeRythm();
+		//Rack records the whole randomize as one history action already
+		ParamBatch batch = noteBlockBatch();
+		randomizeCVs(batch);
+		randomizeRythm(batch);
+		batch.commit();
 
 	  	//Randomize Notes
   		int length = 1;
@@ -354,12 +547,17 @@ struct Sequencer3 : Module, NotePreviewer {
   		params[SEQ_LENGTH_PARAM].setValue(length);
   	}
 
-  	void randomizeCVs(){
+  	//Covers the note blocks through to the note timing, params between them are left alone unless set
+  	ParamBatch noteBlockBatch(){
+  		return ParamBatch(this, NOTE_BLOCK_PARAM, NOTE_TIMING_PARAM + MAX_SEQ_LENGTH * 4 - NOTE_BLOCK_PARAM);
+  	}
+
+  	void randomizeCVs(ParamBatch & batch){
 		using rack::random::uniform;  		
   		
   		//Get Scale
   		int scale = std::floor(uniform()*NUM_OF_SCALES);
-  		std::vector<int> notes = SCALES[scale];
+  		const std::vector<int> & notes = SCALES[scale];
   		int semitoneOffset = rndInt(12)-6;
   		if(uniform() < 0.25) semitoneOffset -= 12;
   		int size = notes.size();
@@ -374,8 +572,6 @@ struct Sequencer3 : Module, NotePreviewer {
   		float lowNoteOdds = uniform() * 0.3 + (uniform() < 0.3 ? 0.3 : 0);
   		float hiteNoteOdds = uniform() * 0.3 + (uniform() < 0.3 ? 0.3 : 0);
 
-  		DEBUG("randomizeCVs");
-
   		//Walk Block
   		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
   			bool wholeBlockSame = uniform() < wholeBlockSameOdds;
@@ -398,19 +594,16 @@ struct Sequencer3 : Module, NotePreviewer {
 		  		}
 
 	  			float cv = (notes[ri]+semitoneOffset) / 12.f;
-	  			DEBUG("ri: %i cv: %f",ri,cv);
 
 	  			//Chance for octave shift
 	  			if(uniform() < octaveShiftOdds){
 	  				if(uniform() < highVsLowOctaveOdds){
 	  					if(cv <= NoteEntryWidget_MAX - 1){
 	  						cv += 1;
-	  						DEBUG("+1 octave cv: %f",cv);
 	  					}
 	  				}else{
 	  					if(cv >= NoteEntryWidget_MIN + 1){
 	  						cv -= 1;
-	  						DEBUG("-1 octave cv: %f",cv);
 	  					}
 	  				}
 	  			}
@@ -419,15 +612,14 @@ struct Sequencer3 : Module, NotePreviewer {
 	  			//Replace cv with previous if wholeBlockSame and not the first note in the block
 	  			if(ni > 0 && wholeBlockSame){
 	  				cv = prevCV;
-	  				DEBUG("wholeBlockSame cv: %f",cv);
 	  			}
-	  			params[NOTE_BLOCK_PARAM + bi * NOTE_BLOCK_PARAM_COUNT + 1 + ni * 2].setValue(cv);
+	  			batch.setValue(bi * NOTE_BLOCK_PARAM_COUNT + 1 + ni * 2, cv);
 	  			prevCV = cv;
 	  		}
 	  	}
   	}
 
-  	void randomizeRythm(){
+  	void randomizeRythm(ParamBatch & batch){
 		using rack::random::uniform;  		
   		
 		bool allowTripplets = uniform() < 0.3;
@@ -458,39 +650,117 @@ struct Sequencer3 : Module, NotePreviewer {
   				if(uniform() < extraQuarterOdds) subdivision = SubDiv_Quarter;
   				if(uniform() < extraEighthOdds) subdivision = SubDiv_Eighth;
   			}
-  			params[NOTE_BLOCK_PARAM + bi * NOTE_BLOCK_PARAM_COUNT].setValue(subdivision);
+  			batch.setValue(bi * NOTE_BLOCK_PARAM_COUNT, subdivision);
 
   			//Set Note Extra
 	  		for(int ni = 0; ni < 4; ni++){
 	  			NoteExtra noteExtra = NE_NONE;
 	  			if(uniform() < 0.1) noteExtra = NE_MUTE;
 	  			if(ni == 0 && bi != 0 && uniform() < 0.05)  noteExtra = NE_TIE;
-	  			params[NOTE_BLOCK_PARAM + bi * NOTE_BLOCK_PARAM_COUNT + 2 + ni * 2].setValue(noteExtra);
+	  			batch.setValue(bi * NOTE_BLOCK_PARAM_COUNT + 2 + ni * 2, noteExtra);
 	  		}
 	  	}
   	}
 
-  	void shiftBlocks(int delta){
-  		//Also shift current pulse to prevent weird hickups in play back
-  		currentPulse += delta * 24;
+  	int playingBlockCount(){
+  		return clamp((int) (params[SEQ_LENGTH_PARAM].getValue() * seqLengthScalar), 1, MAX_SEQ_LENGTH);
+  	}
+
+  	void readPattern(std::vector<NoteBlock> & pattern){
+  		NoteBlockPattern playing;
+  		readNoteBlockPattern(this, NOTE_BLOCK_PARAM, playingBlockCount(), playing);
+  		pattern.assign(playing.blocks, playing.blocks + playing.blockCount);
+  	}
+
+  	//Starts a variation learned from the playing blocks plus the library. The widget commits the result.
+  	bool startMarkovVariation(){
+  		std::vector<NoteBlock> pattern;
+  		readPattern(pattern);
+  		return markov.start(pattern, markovLibrary, MAX_SEQ_LENGTH, random::u64());
+  	}
+
+  	void learnCurrentPattern(){
+  		std::vector<NoteBlock> pattern;
+  		readPattern(pattern);
+  		markovLibrary.learn(pattern);
+  	}
+
+  	//Adds the blocks from a Sequencer3 .vcvm preset to the library
+  	bool learnPresetFile(std::string path){
+  		json_error_t error;
+  		json_t* root = json_load_file(path.c_str(), 0, &error);
+  		if(!root){
+  			WARN("Could not load preset %s: %s", path.c_str(), error.text);
+  			return false;
+  		}
 
-  		delta *= NOTE_BLOCK_PARAM_COUNT;
   		const int MAX = MAX_SEQ_LENGTH * NOTE_BLOCK_PARAM_COUNT;
   		float paramValues [MAX] = {};
-  		for(int i = 0; i < MAX; i++){
-  			paramValues[i] = params[NOTE_BLOCK_PARAM + i].getValue();
+  		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
+  			paramValues[bi * NOTE_BLOCK_PARAM_COUNT] = SubDiv_Quarter;
+  		}
+  		int blockCount = MAX_SEQ_LENGTH;
+
+  		json_t* jParams = json_object_get(root, "params");
+  		for(size_t i = 0; i < json_array_size(jParams); i++){
+  			json_t* jParam = json_array_get(jParams, i);
+  			int id = json_integer_value(json_object_get(jParam, "id"));
+  			float value = json_number_value(json_object_get(jParam, "value"));
+  			if(id >= NOTE_BLOCK_PARAM && id < NOTE_BLOCK_PARAM + MAX) paramValues[id - NOTE_BLOCK_PARAM] = value;
+  			if(id == SEQ_LENGTH_PARAM) blockCount = clamp((int) value, 1, MAX_SEQ_LENGTH);
+  		}
+  		json_decref(root);
+
+  		std::vector<NoteBlock> pattern;
+  		for(int bi = 0; bi < blockCount; bi++){
+  			pattern.push_back(readNoteBlock(&paramValues[bi * NOTE_BLOCK_PARAM_COUNT]));
   		}
+  		markovLibrary.learn(pattern);
+  		return true;
+  	}
+
+  	void shiftBlocks(ParamBatch & batch, int delta){
+  		//Also shift current pulse to prevent weird hickups in play back
+  		seq.shift(delta);
+
+  		delta *= NOTE_BLOCK_PARAM_COUNT;
+  		const int MAX = MAX_SEQ_LENGTH * NOTE_BLOCK_PARAM_COUNT;
+  		std::vector<float> paramValues = batch.newValues;
   		for(int i = 0; i < MAX; i++){
   			int i2 = i - delta;
   			i2 = mod_0_max(i2,MAX);
-  			params[NOTE_BLOCK_PARAM + i].setValue(paramValues[i2]);
+  			batch.setValue(i, paramValues[i2]);
+  		}
+
+  		//Note timing moves with its block
+  		int timingDelta = delta / NOTE_BLOCK_PARAM_COUNT * 4;
+  		const int TIMING_START = NOTE_TIMING_PARAM - NOTE_BLOCK_PARAM;
+  		const int TIMING_MAX = MAX_SEQ_LENGTH * 4;
+  		for(int i = 0; i < TIMING_MAX; i++){
+  			int i2 = mod_0_max(i - timingDelta, TIMING_MAX);
+  			batch.setValue(TIMING_START + i, paramValues[TIMING_START + i2]);
   		}
   	}
 };
 
 struct Sequencer3Widget : ModuleWidget {
 	NoteEntryWidgetPanel * noteEntry;
+	NoteMenuPool noteMenuPool;
 	NoteBlockWidget* noteBlocks[MAX_SEQ_LENGTH];
+	RingLightBatch* ringLights = NULL;
+	PianoRollWidget* pianoRoll = NULL;
+#ifdef JPLAB_PROFILE
+	ProfileOverlay* profileOverlay;
+
+	//Frame costs of the widget tree, measured on the UI thread which is its only writer
+	enum UiProfilePhase{
+		UI_PROFILE_STEP,
+		UI_PROFILE_DRAW,
+		UI_PROFILE_LIGHTS,
+	};
+	Profiler uiProfiler{std::vector<const char*>{"UI Step", "UI Draw", "UI Lights"}};
+	ProfileOverlay* uiProfileOverlay;
+#endif
 	Sequencer3Widget(Sequencer3* module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/Blank36hp.svg")));
@@ -521,6 +791,7 @@ struct Sequencer3Widget : ModuleWidget {
 			addParam(createParamCentered<RotarySwitch<RoundSmallBlackKnob>>(Vec(x,y), module, Sequencer3::SEQ_LENGTH_PARAM));
 
 			x += dx;
+			addInput(createInputCentered<PJ301MPort>(Vec(x,y), module, Sequencer3::BPM_INPUT));
 
 			x += dx;
 			addParam(createParamCentered<CKSS>(Vec(x,y), module, Sequencer3::EVOLUTION_ON_PARAM));
@@ -533,6 +804,11 @@ struct Sequencer3Widget : ModuleWidget {
 			noteEntry->module = module;
 			noteEntry->baseParamIndex = Sequencer3::NOTE_BLOCK_PARAM;
 			addChild(noteEntry);
+
+			OutputScopeWidget* scope = createWidget<OutputScopeWidget>(Vec(1.25f * dx, yStart + dy * 7));
+			scope->box.size = Vec(noteEntry->box.size.x, dy * 2.2f);
+			scope->ring = module ? &module->scope : NULL;
+			addChild(scope);
 		}
 
 		// for(int ni = 0; ni < MAX_SEQ_LENGTH; ni++){			
@@ -550,7 +826,19 @@ struct Sequencer3Widget : ModuleWidget {
 		// 	}
 		// }
 
-		{
+		if(module == NULL){
+			//The module browser only needs the look, so draw static blocks once into a framebuffer
+			float dx2 = dx * 2.16;
+			float dy2 = dy * 2.65;
+			widget::FramebufferWidget* preview = new widget::FramebufferWidget;
+			preview->box.size = box.size;
+			for(int row = 0; row < ROW_COUNT; row ++){
+				for(int col = 0; col < COL_COUNT; col++){
+					preview->addChild(createWidget<NoteBlockPreview>(Vec(0.2 * dx + dx2 * col, dy * 0.5 + dy2 * row)));
+				}
+			}
+			addChild(preview);
+		}else{
 			float dx2 = dx * 2.16;
 			float dy2 = dy * 2.65;
 			for(int row = 0; row < ROW_COUNT; row ++){
@@ -558,15 +846,45 @@ struct Sequencer3Widget : ModuleWidget {
 					int i = (row * COL_COUNT + col);
 					int i2 = i * NOTE_BLOCK_PARAM_COUNT;
 					NoteBlockWidget* noteBlock = createWidget<NoteBlockWidget>(Vec(0.2 * dx + dx2 * col, dy * 0.5 + dy2 * row));
-					noteBlock->init(module, noteEntry, i, Sequencer3::NOTE_BLOCK_PARAM + i2);
+					noteBlock->init(module, noteEntry, i, Sequencer3::NOTE_BLOCK_PARAM + i2, Sequencer3::NOTE_TIMING_PARAM + i * 4, &noteMenuPool);
 					addChild(noteBlock);		
 					noteBlocks[i] = noteBlock;
 				}
 			}
+
+			//Above the note blocks so the rings draw over the knobs
+			ringLights = createWidget<RingLightBatch>(Vec(0,0));
+			ringLights->box.size = box.size;
+			for(int i = 0; i < MAX_SEQ_LENGTH; i++){
+				for(int ni = 0; ni < 4; ni++){
+					ringLights->addNote(noteBlocks[i]->noteWidget[ni]);
+				}
+			}
+			addChild(ringLights);
+
+			pianoRoll = createWidget<PianoRollWidget>(Vec(0.2 * dx, dy * 0.5));
+			pianoRoll->box.size = Vec(dx2 * COL_COUNT, dy2 * ROW_COUNT);
+			pianoRoll->init(module, Sequencer3::NOTE_BLOCK_PARAM);
+			pianoRoll->hide();
+			addChild(pianoRoll);
 		}
 		
 
 
+#ifdef JPLAB_PROFILE
+		profileOverlay = createWidget<ProfileOverlay>(Vec(0,0));
+		profileOverlay->box.size = Vec(box.size.x, RACK_GRID_WIDTH * 10);
+		profileOverlay->profiler = module ? &module->profiler : NULL;
+		profileOverlay->hide();
+		addChild(profileOverlay);
+
+		uiProfileOverlay = createWidget<ProfileOverlay>(Vec(0,profileOverlay->box.size.y));
+		uiProfileOverlay->box.size = profileOverlay->box.size;
+		uiProfileOverlay->profiler = &uiProfiler;
+		uiProfileOverlay->hide();
+		addChild(uiProfileOverlay);
+#endif
+
 		// QuantizerDisplay* quantizerDisplay = createWidget<QuantizerDisplay>(Vec(x,y));
 		// QuantizerDisplay* quantizerDisplay = createWidget<QuantizerDisplay>(mm2px(Vec(0.0, 13.039)));
 		// quantizerDisplay->box.size = mm2px(Vec(15.24, 55.88));
@@ -578,14 +896,76 @@ struct Sequencer3Widget : ModuleWidget {
 	int prevLastBlock;
 	int prevLastNote;
 
+	//Heatmap state, the block pulse counts at the last step and their decaying sums
+	static constexpr float HEAT_DECAY_TIME = 8.f; //Seconds for the heat to fall to about a third
+	uint32_t prevBlockPulses[MAX_SEQ_LENGTH] = {};
+	float blockHeat[MAX_SEQ_LENGTH] = {};
+
+	void updateHeatmap(Sequencer3* module){
+		float decay = std::exp(-APP->window->getLastFrameDuration() / HEAT_DECAY_TIME);
+		float maxHeat = 0;
+		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
+			uint32_t pulses = module->seq.blockPulses[bi].load(std::memory_order_relaxed);
+			blockHeat[bi] = blockHeat[bi] * decay + (uint32_t) (pulses - prevBlockPulses[bi]);
+			prevBlockPulses[bi] = pulses;
+			maxHeat = std::max(maxHeat, blockHeat[bi]);
+		}
+		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
+			noteBlocks[bi]->heat = module->blockHeatmap && maxHeat > 0 && bi < module->heatBlocks ? blockHeat[bi] / maxHeat : 0;
+		}
+	}
+
+	//The block evolution plays in place of each block next, the genetic worker's best candidate or the random mapping.
+	//Only drawn on the module that evolves, and only where both blocks are its own.
+	void updatePianoRollGhosts(Sequencer3* module){
+		bool evolving = !module->displayFollower && module->params[Sequencer3::EVOLUTION_ON_PARAM].getValue() == 1;
+		bool genetic = module->seq.getEvolutionMode() == EM_GENETIC;
+		for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
+			int ghost = -1;
+			if(evolving && bi < module->heatBlocks){
+				ghost = (genetic ? module->seq.genetic.candidateView[bi] : module->seq.mappingView[bi]).load(std::memory_order_relaxed);
+				if(ghost >= module->heatBlocks) ghost = -1;
+			}
+			pianoRoll->ghostBlock[bi] = ghost;
+		}
+	}
+
 	void step() override {
+		PROFILE_BEGIN(uiProfiler);
+		PROFILE_SCOPE(uiProfiler, UI_PROFILE_STEP);
 		ModuleWidget::step();
 		
 		Sequencer3* module = dynamic_cast<Sequencer3*>(this->module);
 		if(module == NULL) return;
 
-		int pulse = module->currentPulse;
-		int pulseEvolved = module->currentEvolvedPulse;
+		module->updateGroove();
+		ringLights->trails = module->noteTrails;
+
+		if(pianoRoll->isVisible() != module->pianoRoll){
+			pianoRoll->setVisible(module->pianoRoll);
+			ringLights->setVisible(!module->pianoRoll);
+			for(int bi = 0; bi < MAX_SEQ_LENGTH; bi++){
+				noteBlocks[bi]->setVisible(!module->pianoRoll);
+			}
+		}
+		pianoRoll->blockCount = module->playingBlockCount();
+		pianoRoll->playPulse = module->displayRunning ? module->displayPulse : -1;
+		pianoRoll->evolvedPulse = module->displayEvolvedPulse;
+		if(module->pianoRoll) updatePianoRollGhosts(module);
+
+		updateHeatmap(module);
+
+		std::vector<NoteBlock> variation;
+		if(module->markov.poll(variation)){
+			ParamBatch batch = module->noteBlockBatch();
+			for(size_t bi = 0; bi < variation.size(); bi++){
+				writeNoteBlock(batch, bi, variation[bi]);
+			}
+			batch.commit("markov variation");
+		}
+
+		int pulse = module->displayPulse;
+		int pulseEvolved = module->displayEvolvedPulse;
 		int lastBlockIndex = this->noteEntry->lastBlockIndex;
 		int lastNoteIndex = this->noteEntry->lastNoteIndex;
 		
@@ -608,11 +988,14 @@ struct Sequencer3Widget : ModuleWidget {
 		}
 
 		if(dirty){
+			NoteBlockPattern pattern;
+			readNoteBlockPattern(module,Sequencer3::NOTE_BLOCK_PARAM,MAX_SEQ_LENGTH,pattern);
+
 			int block, noteIndex;
-			getNoteAndBlock(module,Sequencer3::NOTE_BLOCK_PARAM,pulse,block,noteIndex);
+			getNoteAndBlock(pattern,pulse,block,noteIndex);
 
 			int blockEvolved, noteEvolved;
-			getNoteAndBlock(module,Sequencer3::NOTE_BLOCK_PARAM,pulseEvolved,blockEvolved,noteEvolved);
+			getNoteAndBlock(pattern,pulseEvolved,blockEvolved,noteEvolved);
 
 			//DEBUG("pulse:%i block:%i blockType:%i pulseInBlock:%i noteIndexInBlock:%i ",pulse,block,blockType,pulseInBlock,noteIndexInBlock);
 			
@@ -634,11 +1017,49 @@ struct Sequencer3Widget : ModuleWidget {
 					}
 					noteBlocks[bi]->setColor(ni,color);
 				}
-				noteBlocks[bi]->updateDisplay();
 			}
 		}
 	}
 
+#ifdef JPLAB_PROFILE
+	void draw(const DrawArgs& args) override {
+		PROFILE_SCOPE(uiProfiler, UI_PROFILE_DRAW);
+		ModuleWidget::draw(args);
+	}
+
+	void drawLayer(const DrawArgs& args, int layer) override {
+		if(layer == 1){
+			PROFILE_SCOPE(uiProfiler, UI_PROFILE_LIGHTS);
+			ModuleWidget::drawLayer(args, layer);
+			return;
+		}
+		ModuleWidget::drawLayer(args, layer);
+	}
+#endif
+
+	static void addGeneticWeightMenu(Sequencer3* module, Menu* menu, std::string label, float GeneticSettings::* weight){
+		static const std::string WEIGHT_LABELS[3] = {"Off","Low","High"};
+		static const float WEIGHTS[3] = {0.f, 0.5f, 1.f};
+		float current = module->seq.genetic.getSettings().*weight;
+		std::string rightText = "";
+		for(int i = 0; i < 3; i++){
+			if(current == WEIGHTS[i]) rightText = WEIGHT_LABELS[i];
+		}
+		menu->addChild(createSubmenuItem(label, rightText,
+			[=](Menu* menu) {
+				for(int i = 0; i < 3; i++){
+					menu->addChild(createMenuItem(WEIGHT_LABELS[i], CHECKMARK(current == WEIGHTS[i]),
+						[=]() {
+							GeneticSettings s = module->seq.genetic.getSettings();
+							s.*weight = WEIGHTS[i];
+							module->seq.genetic.setSettings(s);
+						}
+					));
+				}
+			}
+		));
+	}
+
 	void appendContextMenu(Menu* menu) override {
 		Sequencer3* module = dynamic_cast<Sequencer3*>(this->module);
 
@@ -649,13 +1070,233 @@ struct Sequencer3Widget : ModuleWidget {
 			[module](Menu* menu) {
 				menu->addChild(createMenuItem("CVs", "",
 					[=]() {
-						module->randomizeCVs();
+						ParamBatch batch = module->noteBlockBatch();
+						module->randomizeCVs(batch);
+						batch.commit("randomize CVs");
 					}
 				));
 
 				menu->addChild(createMenuItem("Rythm", "",
 					[=]() {
-						module->randomizeRythm();
+						ParamBatch batch = module->noteBlockBatch();
+						module->randomizeRythm(batch);
+						batch.commit("randomize rythm");
+					}
+				));
+			}
+		));
+
+		menu->addChild(createSubmenuItem("Clock", module->seq.tempo.isEnabled() ? "Smoothed" : "",
+			[module](Menu* menu) {
+				menu->addChild(createMenuLabel("Start"));
+				menu->addChild(createMenuItem("Wait for Second Edge", CHECKMARK(!module->seq.clock.predictStart),
+					[=]() {
+						module->seq.clock.predictStart = false;
+					}
+				));
+				menu->addChild(createMenuItem("Predict Tempo", CHECKMARK(module->seq.clock.predictStart),
+					[=]() {
+						module->seq.clock.predictStart = true;
+					}
+				));
+
+				menu->addChild(new MenuEntry); //Blank Row
+
+				menu->addChild(createMenuLabel("Resolution"));
+				for(int i = 0; i < PPQN_OPTION_COUNT; i++){
+					int ppqn = PPQN_OPTIONS[i];
+					menu->addChild(createMenuItem(string::f("%d PPQN", ppqn), CHECKMARK(module->seq.requestedPpqn == ppqn),
+						[=]() {
+							module->seq.setPpqn(ppqn);
+						}
+					));
+				}
+
+				menu->addChild(new MenuEntry); //Blank Row
+
+				static const std::string LOCK_LABELS[4] = {"Off","Phase Lock","4 Beats","16 Beats"};
+				static const float LOCK_BEATS[4] = {0.f, 1.f, 4.f, 16.f};
+				menu->addChild(createMenuLabel("Smoothing"));
+				for(int i = 0; i < 4; i++){
+					menu->addChild(createMenuItem(LOCK_LABELS[i], CHECKMARK(module->seq.tempo.lockBeats == LOCK_BEATS[i]),
+						[=]() {
+							module->seq.tempo.lockBeats = LOCK_BEATS[i];
+						}
+					));
+				}
+
+				static const std::string OUTLIER_LABELS[4] = {"Off","10%","25%","50%"};
+				static const float OUTLIER_RATIOS[4] = {0.f, 0.1f, 0.25f, 0.5f};
+				menu->addChild(new MenuEntry); //Blank Row
+				menu->addChild(createMenuLabel("Outlier Rejection"));
+				for(int i = 0; i < 4; i++){
+					menu->addChild(createMenuItem(OUTLIER_LABELS[i], CHECKMARK(module->seq.tempo.outlierRatio == OUTLIER_RATIOS[i]),
+						[=]() {
+							module->seq.tempo.outlierRatio = OUTLIER_RATIOS[i];
+						},
+						!module->seq.tempo.isEnabled()
+					));
+				}
+			}
+		));
+
+		addResetMenu(menu, &module->seq.reset);
+		addGateMenu(menu, &module->seq.gate);
+
+		menu->addChild(createMenuItem("Note Trails", CHECKMARK(module->noteTrails),
+			[=]() {
+				module->noteTrails = !module->noteTrails;
+			}
+		));
+
+		menu->addChild(createMenuItem("Piano Roll", CHECKMARK(module->pianoRoll),
+			[=]() {
+				module->pianoRoll = !module->pianoRoll;
+			}
+		));
+
+		menu->addChild(createMenuItem("Block Heatmap", CHECKMARK(module->blockHeatmap),
+			[=]() {
+				module->blockHeatmap = !module->blockHeatmap;
+			}
+		));
+
+		menu->addChild(createSubmenuItem("Groove", GROOVE_TEMPLATE_NAMES[module->grooveTemplate],
+			[module](Menu* menu) {
+				menu->addChild(createMenuLabel("Applied from the next bar"));
+				for(int i = 0; i < GROOVE_TEMPLATE_COUNT; i++){
+					menu->addChild(createMenuItem(GROOVE_TEMPLATE_NAMES[i], CHECKMARK(module->grooveTemplate == i),
+						[=]() {
+							module->grooveTemplate = i;
+						}
+					));
+				}
+				if(module->grooveTemplate == GROOVE_CUSTOM){
+					menu->addChild(new MenuEntry); //Blank Row
+					for(int si = 0; si < GROOVE_STEPS; si++){
+						ui::Slider* slider = new ui::Slider;
+						slider->quantity = module->paramQuantities[Sequencer3::GROOVE_PARAM + si];
+						slider->box.size.x = 200.f;
+						menu->addChild(slider);
+					}
+				}
+			}
+		));
+
+		menu->addChild(createSubmenuItem("Evolution", module->seq.getEvolutionMode() == EM_GENETIC ? "Genetic" : "Random",
+			[module](Menu* menu) {
+				menu->addChild(createMenuItem("Random", CHECKMARK(module->seq.getEvolutionMode() == EM_RANDOM),
+					[=]() {
+						module->setEvolutionMode(EM_RANDOM);
+					}
+				));
+				menu->addChild(createMenuItem("Genetic", CHECKMARK(module->seq.getEvolutionMode() == EM_GENETIC),
+					[=]() {
+						module->setEvolutionMode(EM_GENETIC);
+					}
+				));
+
+				if(module->seq.getEvolutionMode() != EM_GENETIC) return;
+
+				GeneticSettings settings = module->seq.genetic.getSettings();
+
+				menu->addChild(new MenuEntry); //Blank Row
+				menu->addChild(createMenuLabel(string::f("Last loop: %d candidates, fitness %.2f", module->seq.genetic.lastCandidates.load(), module->seq.genetic.lastFitness.load())));
+
+				menu->addChild(createSubmenuItem("Scale", SCALE_LABELS[settings.scale],
+					[=](Menu* menu) {
+						for(int i = 0; i < NUM_OF_SCALES; i++){
+							menu->addChild(createMenuItem(SCALE_LABELS[i], CHECKMARK(settings.scale == i),
+								[=]() {
+									GeneticSettings s = module->seq.genetic.getSettings();
+									s.scale = i;
+									module->seq.genetic.setSettings(s);
+								}
+							));
+						}
+					}
+				));
+
+				static const std::string ROOT_LABELS[12] = {"C","C#","D","D#","E","F","F#","G","G#","A","A#","B"};
+				menu->addChild(createSubmenuItem("Root", ROOT_LABELS[settings.root],
+					[=](Menu* menu) {
+						for(int i = 0; i < 12; i++){
+							menu->addChild(createMenuItem(ROOT_LABELS[i], CHECKMARK(settings.root == i),
+								[=]() {
+									GeneticSettings s = module->seq.genetic.getSettings();
+									s.root = i;
+									module->seq.genetic.setSettings(s);
+								}
+							));
+						}
+					}
+				));
+
+				addGeneticWeightMenu(module, menu, "Scale Adherence", &GeneticSettings::scaleWeight);
+				addGeneticWeightMenu(module, menu, "Contour Smoothness", &GeneticSettings::smoothWeight);
+				addGeneticWeightMenu(module, menu, "Density", &GeneticSettings::densityWeight);
+
+				menu->addChild(createSubmenuItem("Density Target", string::f("%g notes", settings.densityTarget),
+					[=](Menu* menu) {
+						for(int i = 1; i <= 4; i++){
+							menu->addChild(createMenuItem(string::f("%d notes per block", i), CHECKMARK(settings.densityTarget == i),
+								[=]() {
+									GeneticSettings s = module->seq.genetic.getSettings();
+									s.densityTarget = i;
+									module->seq.genetic.setSettings(s);
+								}
+							));
+						}
+					}
+				));
+
+				menu->addChild(createSubmenuItem("Time Budget", string::f("%g ms", settings.budgetMs),
+					[=](Menu* menu) {
+						static const float BUDGETS[] = {0.5f, 1.f, 2.f, 5.f, 10.f};
+						for(float budget : BUDGETS){
+							menu->addChild(createMenuItem(string::f("%g ms per loop", budget), CHECKMARK(settings.budgetMs == budget),
+								[=]() {
+									GeneticSettings s = module->seq.genetic.getSettings();
+									s.budgetMs = budget;
+									module->seq.genetic.setSettings(s);
+								}
+							));
+						}
+					}
+				));
+			}
+		));
+
+		menu->addChild(createSubmenuItem("Markov", "",
+			[module](Menu* menu) {
+				menu->addChild(createMenuItem("Generate Variation", "",
+					[=]() {
+						module->startMarkovVariation();
+					},
+					module->markov.busy
+				));
+
+				menu->addChild(createMenuItem("Learn Current Pattern", "",
+					[=]() {
+						module->learnCurrentPattern();
+					}
+				));
+
+				menu->addChild(createMenuItem("Learn Preset File...", "",
+					[=]() {
+						osdialog_filters* filters = osdialog_filters_parse("VCV Rack module preset (.vcvm):vcvm");
+						char* pathC = osdialog_file(OSDIALOG_OPEN, asset::user("presets").c_str(), NULL, filters);
+						osdialog_filters_free(filters);
+						if(!pathC) return;
+						std::string path = pathC;
+						std::free(pathC);
+						module->learnPresetFile(path);
+					}
+				));
+
+				menu->addChild(createMenuItem("Clear Library", string::f("%d patterns", module->markovLibrary.patternsLearned),
+					[=]() {
+						module->markovLibrary.clear();
 					}
 				));
 			}
@@ -665,19 +1306,26 @@ struct Sequencer3Widget : ModuleWidget {
 			[module](Menu* menu) {
 				menu->addChild(createMenuItem("Block Forward", "",
 					[=]() {
-						module->shiftBlocks(+1);
+						ParamBatch batch = module->noteBlockBatch();
+						module->shiftBlocks(batch,+1);
+						batch.commit("shift blocks");
 					}
 				));
 
 				menu->addChild(createMenuItem("Block Backward", "",
 					[=]() {
-						module->shiftBlocks(-1);
+						ParamBatch batch = module->noteBlockBatch();
+						module->shiftBlocks(batch,-1);
+						batch.commit("shift blocks");
 					}
 				));
 			}
 		));
 
-		
+#ifdef JPLAB_PROFILE
+		addProfileMenu(menu, &module->profiler, profileOverlay);
+		addProfileMenu(menu, &uiProfiler, uiProfileOverlay, "UI Profiling");
+#endif
 	}
 
 
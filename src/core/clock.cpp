@@ -0,0 +1,112 @@
+#include "clock.hpp"
+#include <cmath>
+
+void ClockDetector::rescale(double ratio){
+	bool hadPeriod = hasPeriod();
+	clockCounter = (int)std::round(clockCounter * ratio);
+	clockLength = (int)std::round(clockLength * ratio);
+	predictedLength = (int)std::round(predictedLength * ratio);
+	//Rounding must not turn a measured period into no period
+	if(hadPeriod && clockLength < 1) clockLength = 1;
+}
+
+bool TempoEstimator::process(int rawPeriod){
+	if(rawPeriod <= 0) return false;
+	if(period <= 0){
+		period = rawPeriod;
+		return true;
+	}
+
+	if(outlierRatio > 0 && std::abs(rawPeriod - period) > period * outlierRatio){
+		//Count outliers that agree with each other, a lone stray edge breaks the run
+		if(outlierCount > 0 && std::abs(rawPeriod - outlierPeriod) <= outlierPeriod * outlierRatio){
+			outlierCount++;
+		}else{
+			outlierCount = 1;
+		}
+		outlierPeriod = rawPeriod;
+		if(outlierCount < 3) return false;
+		//The tempo really changed, jump straight to it
+		period = rawPeriod;
+		outlierCount = 0;
+		return true;
+	}
+	outlierCount = 0;
+
+	if(lockBeats <= 1) period = rawPeriod;
+	else period += (rawPeriod - period) / lockBeats;
+	return true;
+}
+
+bool PulseClock::process(int clockLength, bool edge, TempoEstimator & tempo, int ppqn){
+	if(!tempo.isEnabled()){
+		if(wholeSamples){
+			//A faster clock ends the pulse counted at the old length early instead of running it long
+			if(pulseCounter > clockLength / ppqn) pulseCounter = clockLength / ppqn;
+			if(pulseCounter > 0){
+				pulseCounter--;
+				return false;
+			}
+			pulseCounter = clockLength / ppqn;
+			return true;
+		}
+		if(clockLength <= 0) return false;
+		pulseRate = (double) ppqn / clockLength;
+	}else if(edge && tempo.period > 0){
+		//Position in the beat including this sample. In sync this lands on a whole beat as the edge's pulse is due.
+		double elapsed = pulseInBeat - 1 + pulsePhase + pulseRate;
+		//How far the pulses drifted from the clock this beat, wrapped so the grid moves the short way
+		double error = ppqn - elapsed;
+		error -= ppqn * std::floor(error / ppqn + 0.5);
+		double gain = tempo.lockBeats > 1 ? 1 / tempo.lockBeats : 1;
+		//Make up the error over the next beat, limited so it never skips or doubles pulses
+		double pulses = ppqn + error * gain;
+		if(pulses < ppqn * 0.5) pulses = ppqn * 0.5;
+		if(pulses > ppqn * 1.5) pulses = ppqn * 1.5;
+		pulseRate = pulses / tempo.period;
+	}else if(pulseRate <= 0 && tempo.period > 0){
+		pulseRate = ppqn / tempo.period;
+	}
+
+	pulsePhase += pulseRate;
+	if(pulsePhase >= 1){
+		pulsePhase -= 1;
+		if(pulsePhase >= 1) pulsePhase = 0;
+		pulseInBeat++;
+		if(pulseInBeat >= ppqn) pulseInBeat = 0;
+		return true;
+	}
+	return false;
+}
+
+void PulseClock::catchUp(int samples){
+	if(samples <= 0) return;
+	if(wholeSamples){
+		pulseCounter = pulseCounter > samples ? pulseCounter - samples : 0;
+	}
+	pulsePhase += pulseRate * samples;
+	if(pulsePhase >= 1) pulsePhase = std::nextafter(1.0, 0.0);
+}
+
+bool ResetScheduler::process(float resetVoltage, bool clockEdge, float sampleTime, bool & replayClock){
+	replayClock = false;
+	bool trigger = schmittTrigger(resetHigh, resetVoltage);
+
+	bool reset = false;
+	if(mode == RESET_NEXT_CLOCK){
+		if(trigger) pending = true;
+		if(pending && clockEdge){
+			pending = false;
+			reset = true;
+		}
+	}else if(trigger){
+		pending = false;
+		reset = true;
+		//The clock won the race by a few samples. Without a window no edge is ever replayed, not even one a sample old.
+		replayClock = window > 0 && !clockEdge && sinceClock <= window;
+	}
+
+	if(clockEdge) sinceClock = 0;
+	else if(sinceClock < 1e6) sinceClock += sampleTime;
+	return reset;
+}
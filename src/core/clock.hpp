@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cmath>
+
+//Edge detection and clock measurement shared by every sequencer. No Rack dependencies.
+
+inline void schmittTrigger(bool & state, float input, bool & highEvent, bool & lowEvent){
+	if(!state && input >= 2.0f){
+		state = true;
+		highEvent = true;
+	}else if(state && input <= 0.1f){
+		state = false;
+		lowEvent = true;
+	}
+}
+
+inline bool schmittTrigger(bool & state, float input){
+	if(!state && input >= 2.0f){
+		state = true;
+		return true;
+	}else if(state && input <= 0.1f){
+		state = false;
+		return false;
+	}
+	return false;
+}
+
+inline bool buttonTrigger(bool & state, float input){
+	if(!state && input >= 1.0f){
+		state = true;
+		return true;
+	}else if(state && input <= 0.f){
+		state = false;
+		return false;
+	}
+	return false;
+}
+
+inline void countClockLength(int & clockCounter, int & clockLength, bool clockHighEvent){
+	if(clockHighEvent){
+		clockLength = clockCounter;
+		clockCounter = 0;
+	}
+	clockCounter++;
+}
+
+//Measures the clock period in samples. The first edge only starts the count since there is no period yet,
+//unless predictStart is set and a period is known, in which case it starts straight away and corrects on the next edge.
+struct ClockDetector{
+	bool clockHigh;
+	bool hasHadFirstClockHigh;
+	int clockCounter;
+	int clockLength;
+
+	bool predictStart = false;
+	int predictedLength = 0; //Used for the start edge when set, otherwise the last measured period is
+	bool stopped; //No edge for two periods
+	bool startEvent; //True for the sample a predicted start happened on
+	bool edgeEvent; //Any rising edge, including ones that only start the count
+
+	ClockDetector(){
+		initalize();
+	}
+
+	void initalize(){
+		clockHigh = false;
+		hasHadFirstClockHigh = false;
+		clockCounter = 0;
+		clockLength = 0;
+		stopped = true;
+		startEvent = false;
+		edgeEvent = false;
+	}
+
+	//Returns true on a clock edge that completed a period
+	bool process(float voltage){
+		startEvent = false;
+		bool clockHighEvent = schmittTrigger(clockHigh, voltage);
+		edgeEvent = clockHighEvent;
+		if(clockHighEvent && (!hasHadFirstClockHigh || (predictStart && stopped))){
+			clockHighEvent = false;
+			hasHadFirstClockHigh = true;
+			clockCounter = 0;
+			if(predictStart){
+				int length = predictedLength > 0 ? predictedLength : clockLength;
+				if(length > 0){
+					clockLength = length;
+					startEvent = true;
+				}
+			}
+			stopped = false;
+		}
+		countClockLength(clockCounter, clockLength, clockHighEvent);
+		if(clockHighEvent) stopped = false;
+		else if(clockLength > 0 && clockCounter > clockLength * 2) stopped = true;
+		return clockHighEvent;
+	}
+
+	bool hasPeriod(){
+		return clockLength > 0;
+	}
+
+	//A predicted start only waits while stopped, otherwise pulses free run from the last period
+	bool isRunning(){
+		if(predictStart) return hasPeriod() && !stopped;
+		return hasPeriod();
+	}
+
+	//The next edge will be a start, so predictedLength is worth updating
+	bool waitingForStart(){
+		return !hasHadFirstClockHigh || stopped;
+	}
+
+	//Converts the sample counts after the sample rate changed by ratio (new rate / old rate)
+	void rescale(double ratio);
+};
+
+//Smooths the measured clock period so jittery clocks give a steady sub-clock.
+//Periods far from the estimate are dropped as jitter until a few agree, which is taken as a real tempo change.
+struct TempoEstimator{
+	float lockBeats = 0; //Clock edges to settle on a new tempo, 0 turns the estimator off
+	float outlierRatio = 0; //Relative change in period treated as an outlier, 0 accepts every edge
+
+	double period;
+	double outlierPeriod;
+	int outlierCount;
+
+	TempoEstimator(){
+		reset();
+	}
+
+	void reset(){
+		period = 0;
+		outlierPeriod = 0;
+		outlierCount = 0;
+	}
+
+	bool isEnabled() const{
+		return lockBeats > 0;
+	}
+
+	//Takes the raw edge to edge period in samples. Returns false when the edge was rejected as an outlier.
+	bool process(int rawPeriod);
+
+	void rescale(double ratio){
+		period *= ratio;
+		outlierPeriod *= ratio;
+	}
+};
+
+//Divides the clock into pulses. With the estimator off this is the original free running counter
+//reloaded from the raw period. With it on, a fractional accumulator runs at the estimated rate and is
+//nudged on each clock edge so the pulses stay phase locked to the clock.
+struct PulseClock{
+	//Count whole samples between pulses like the original counter. Only worth it at the resolution patches were
+	//made with, at finer ones the rounding adds up, so the free running counter keeps a fractional phase instead.
+	bool wholeSamples = true;
+
+	int pulseCounter;
+	double pulsePhase;
+	double pulseRate;
+	int pulseInBeat; //Pulses since the start of the beat, the grid the clock edges lock to
+
+	PulseClock(){
+		reset();
+	}
+
+	//The next call to process pulses
+	void reset(){
+		pulseCounter = 0;
+		pulsePhase = 1;
+		pulseRate = 0;
+		pulseInBeat = 0;
+	}
+
+	//Call once per sample. edge is an accepted clock edge. Returns true when a pulse starts.
+	bool process(int clockLength, bool edge, TempoEstimator & tempo, int ppqn);
+
+	//Moves the grid on by samples that already passed, short of the next pulse so none is skipped
+	void catchUp(int samples);
+
+	//The phase is in pulses so it carries over, only the per sample rate and the sample countdown change
+	void rescale(double ratio){
+		pulseCounter = (int)std::round(pulseCounter * ratio);
+		if(ratio > 0) pulseRate /= ratio;
+	}
+};
+
+enum ResetMode{
+	RESET_IMMEDIATE,
+	RESET_NEXT_CLOCK,
+};
+
+//Decides when a reset takes effect relative to the clock so every sequencer lines up the same way,
+//whatever order the cables deliver reset and clock in.
+struct ResetScheduler{
+	ResetMode mode = RESET_IMMEDIATE;
+	float window = 0; //Seconds after a clock edge in which an immediate reset is treated as arriving with that edge
+
+	bool resetHigh;
+	bool pending;
+	float sinceClock;
+
+	ResetScheduler(){
+		initalize();
+	}
+
+	void initalize(){
+		resetHigh = false;
+		pending = false;
+		sinceClock = 1e6;
+	}
+
+	//Call once per sample before handling the clock. Returns true when the module should reset now.
+	//replayClock is set when the clock edge the reset belongs to was already handled, so it should be handled again after the reset.
+	bool process(float resetVoltage, bool clockEdge, float sampleTime, bool & replayClock);
+};
@@ -0,0 +1,348 @@
+#include "evolution.hpp"
+#include "scales.hpp"
+#include <cmath>
+#include <algorithm>
+
+void BlockEvolution::clear(){
+	evolveUpOrDownBias = true;
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		evolutionMapping[bi] = -1;
+		randomEvolution[bi] = -1;
+	}
+}
+
+void BlockEvolution::clearRandom(){
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		randomEvolution[bi] = -1;
+	}
+}
+
+static int remapBlock(int block, const int* remap, int blocks){
+	if(block < 0) return -1;
+	if(remap) block = remap[block];
+	return block < blocks ? block : -1;
+}
+
+void BlockEvolution::setBlockSpace(int blocks, const int* remap){
+	if(blocks < 1) blocks = 1;
+	if(blocks > CHAIN_MAX_BLOCKS) blocks = CHAIN_MAX_BLOCKS;
+	if(blocks == blockSpace && !remap) return;
+
+	int mapping [CHAIN_MAX_BLOCKS];
+	int random [CHAIN_MAX_BLOCKS];
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		mapping[bi] = -1;
+		random[bi] = -1;
+	}
+	for(int bi = 0; bi < blockSpace; bi++){
+		int to = remapBlock(bi, remap, blocks);
+		if(to < 0) continue;
+		mapping[to] = remapBlock(evolutionMapping[bi], remap, blocks);
+		random[to] = remapBlock(randomEvolution[bi], remap, blocks);
+	}
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		evolutionMapping[bi] = mapping[bi];
+		randomEvolution[bi] = random[bi];
+	}
+	blockSpace = blocks;
+}
+
+void BlockEvolution::evolve(int maxBlock, CoreRandom & rng){
+	int evolvedBlocks = 0;
+	for(int bi = 0; bi < maxBlock; bi++){
+		if(evolutionMapping[bi] != -1) evolvedBlocks++;
+	}
+	float percentEvolved = evolvedBlocks / (float) maxBlock;
+
+	float evolveUpChance = 1 - percentEvolved;
+
+	//Temp Evolutions
+	{
+		//Mirror Chance
+		for(int bi = 0; bi < blockSpace; bi++){
+			randomEvolution[bi] = -1;
+			//Ranomd chance to ghost to the corresponding block on the other row, or half a chain away
+			if(rng.uniform() < 0.2){
+				randomEvolution[bi] = (bi + blockSpace / 2) % blockSpace;
+			}
+		}
+		
+		//Random One-Time
+		{
+			//Randomly Map one to another temporarily
+			int x = rng.rndInt(maxBlock);
+			int y = rng.rndInt(blockSpace);
+			randomEvolution[x] = y;
+		}
+	}
+
+
+	//Semi-Permeanant Evolution Chance
+	if(rng.uniform() < 0.5){
+
+		if(evolveUpOrDownBias){
+			//DnD Advantage
+			evolveUpChance = 1-evolveUpChance;
+			evolveUpChance = evolveUpChance * evolveUpChance;
+			evolveUpChance = 1-evolveUpChance;
+		}else{
+			//DnD Disadvantage
+			evolveUpChance = evolveUpChance * evolveUpChance;
+		}
+
+		if(rng.uniform() < evolveUpChance){
+			addEvolution(maxBlock, rng);
+		}else{
+			removeEvolution(maxBlock, rng);
+		}
+
+		if(percentEvolved > 0.8 && evolveUpOrDownBias){
+			evolveUpOrDownBias = false;
+		}else if(percentEvolved <= 0 && !evolveUpOrDownBias){
+			evolveUpOrDownBias = true;
+		}
+	}
+}
+
+void BlockEvolution::addEvolution(int maxBlock, CoreRandom & rng){
+	//Runs on the audio thread so collect candidates without allocating
+	int indexes [CHAIN_MAX_BLOCKS];
+	int indexCount = 0;
+	for(int bi = 0; bi < maxBlock && bi < blockSpace; bi++){
+		if(evolutionMapping[bi] == -1) indexes[indexCount++] = bi;
+	}
+	if(indexCount > 0){
+		int inBlock = indexes[rng.rndInt(indexCount)];
+		int outBlock = rng.rndInt(blockSpace);
+		evolutionMapping[inBlock] = outBlock;
+
+		//Chance to map a run of sequential blocks
+		while(rng.uniform() < 0.5){
+			outBlock++;
+			if(outBlock >= blockSpace) return;
+
+			inBlock++;
+			if(inBlock >= blockSpace) return;
+			
+			//Note this allows mapping over existing evolutions
+
+			evolutionMapping[inBlock] = outBlock;
+		}
+	}
+}
+
+void BlockEvolution::removeEvolution(int maxBlock, CoreRandom & rng){
+	int indexes [CHAIN_MAX_BLOCKS];
+	int indexCount = 0;
+	for(int bi = 0; bi < maxBlock && bi < blockSpace; bi++){
+		if(evolutionMapping[bi] != -1) indexes[indexCount++] = bi;
+	}
+	if(indexCount > 0){
+		int inBlock = indexes[rng.rndInt(indexCount)];
+		evolutionMapping[inBlock] = -1;
+
+		//Chance to clear a run of sequential blocks
+		while(rng.uniform() < 0.5){
+			inBlock++;
+			if(inBlock >= blockSpace) return;
+
+			evolutionMapping[inBlock] = -1;
+		}
+	}
+}
+
+int BlockEvolution::mapPulse(int pulse) const{
+	if(pulse < 0) return pulse;
+	int block = pulse / PULSES_PER_BLOCK;
+	if(block >= blockSpace) return pulse;
+	int pulseInBlock = pulse - block * PULSES_PER_BLOCK;
+	int rndBlock = randomEvolution[block];
+	int evolvedBlock = evolutionMapping[block];
+	if(rndBlock != -1) block = rndBlock;
+	else if(evolvedBlock != -1)  block = evolvedBlock;
+	return pulseInBlock + block * PULSES_PER_BLOCK;
+}
+
+float scoreMapping(const NoteBlockPattern & pattern, const int * mapping, int blockCount, const GeneticSettings & settings){
+	const std::vector<int> & scale = SCALES[std::min(std::max(settings.scale, 0), NUM_OF_SCALES - 1)];
+
+	int onsets = 0;
+	int inScale = 0;
+	float intervalSum = 0;
+	int intervals = 0;
+	bool hasPrev = false;
+	float prevCV = 0;
+
+	for(int bi = 0; bi < blockCount; bi++){
+		int mapped = mapping[bi] == -1 ? bi : mapping[bi];
+		if(mapped < 0 || mapped >= pattern.blockCount) continue;
+		const NoteBlock & block = pattern.blocks[mapped];
+
+		int last = lastNoteIndex(block.subdivision);
+		for(int ni = 0; ; ni = nextNoteIndex(block.subdivision, ni)){
+			if(block.extra[ni] == NE_NONE){
+				onsets++;
+				int semitone = (int) std::round(block.cv[ni] * 12) - settings.root;
+				int degree = ((semitone % 12) + 12) % 12 + 1; //SCALES are 1 based
+				if(std::find(scale.begin(), scale.end(), degree) != scale.end()) inScale++;
+				if(hasPrev){
+					intervalSum += std::abs(block.cv[ni] - prevCV) * 12;
+					intervals++;
+				}
+				prevCV = block.cv[ni];
+				hasPrev = true;
+			}
+			if(ni >= last) break;
+		}
+	}
+
+	float score = 0;
+	float weights = 0;
+
+	if(settings.scaleWeight > 0){
+		float adherence = onsets > 0 ? inScale / (float) onsets : 0;
+		score += adherence * settings.scaleWeight;
+		weights += settings.scaleWeight;
+	}
+	if(settings.smoothWeight > 0){
+		//An average leap of an octave or more scores zero
+		float smoothness = intervals > 0 ? std::max(1.f - intervalSum / intervals / 12.f, 0.f) : 1;
+		score += smoothness * settings.smoothWeight;
+		weights += settings.smoothWeight;
+	}
+	if(settings.densityWeight > 0){
+		float density = blockCount > 0 ? onsets / (float) blockCount : 0;
+		float match = std::max(1.f - std::abs(density - settings.densityTarget) / 4.f, 0.f);
+		score += match * settings.densityWeight;
+		weights += settings.densityWeight;
+	}
+
+	return weights > 0 ? score / weights : 0;
+}
+
+void GeneticEvolver::start(uint64_t seed){
+	if(running) return;
+	rng.seed(seed, ~seed);
+	populationReady = false;
+	fresh = false;
+	requested = false;
+	running = true;
+	worker = std::thread([this]() {
+		run();
+	});
+}
+
+void GeneticEvolver::stop(){
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		running = false;
+	}
+	wake.notify_one();
+	if(worker.joinable()) worker.join();
+}
+
+GeneticSettings GeneticEvolver::getSettings(){
+	std::lock_guard<std::mutex> lock(settingsMutex);
+	return settings;
+}
+
+void GeneticEvolver::setSettings(const GeneticSettings & settings){
+	std::lock_guard<std::mutex> lock(settingsMutex);
+	this->settings = settings;
+}
+
+void GeneticEvolver::run(){
+	NoteBlockPattern pattern;
+	while(running){
+		{
+			//Wait for a request, and for the audio thread to take the last result before publishing another
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			bool ready = wake.wait_for(lock, std::chrono::seconds(1), [this]() {
+				return !running || (requested.load(std::memory_order_acquire) && !fresh.load(std::memory_order_acquire));
+			});
+			if(!ready || !running) continue;
+		}
+
+		pattern = requestPattern;
+		int blockCount = requestBlocks;
+		int blockSpace = requestSpace;
+		requested.store(false, std::memory_order_release);
+
+		runGeneration(pattern, blockCount, getSettings(), blockSpace);
+		for(int bi = 0; bi < GENETIC_MAX_BLOCKS; bi++){
+			candidateView[bi].store(best.mapping[bi], std::memory_order_relaxed);
+		}
+		fresh.store(true, std::memory_order_release);
+	}
+}
+
+int GeneticEvolver::runGeneration(const NoteBlockPattern & pattern, int blockCount, const GeneticSettings & settings, int blockSpace){
+	using clock = std::chrono::steady_clock;
+	clock::time_point deadline = clock::now() + std::chrono::microseconds((int64_t) (settings.budgetMs * 1000));
+
+	blockSpace = std::min(std::max(blockSpace, 1), GENETIC_MAX_BLOCKS);
+	blockCount = std::min(std::max(blockCount, 1), blockSpace);
+
+	if(!populationReady || populationSpace != blockSpace){
+		//Seed with the unevolved sequence so the population never starts worse than the pattern itself
+		for(int pi = 0; pi < GENETIC_POPULATION; pi++){
+			for(int bi = 0; bi < GENETIC_MAX_BLOCKS; bi++){
+				population[pi].mapping[bi] = (bi >= blockSpace || pi == 0 || rng.uniform() < 0.7f) ? -1 : rng.rndInt(blockSpace);
+			}
+		}
+		populationReady = true;
+		populationSpace = blockSpace;
+	}
+
+	//The pattern or settings may have changed since the last loop
+	int worst = 0;
+	int bestIndex = 0;
+	for(int pi = 0; pi < GENETIC_POPULATION; pi++){
+		population[pi].fitness = scoreMapping(pattern, population[pi].mapping, blockCount, settings);
+		if(population[pi].fitness < population[worst].fitness) worst = pi;
+		if(population[pi].fitness > population[bestIndex].fitness) bestIndex = pi;
+	}
+	int candidates = GENETIC_POPULATION;
+
+	GeneticCandidate child;
+	do{
+		//Tournament select two parents
+		int a = rng.rndInt(GENETIC_POPULATION);
+		int b = rng.rndInt(GENETIC_POPULATION);
+		const GeneticCandidate & p1 = population[a].fitness > population[b].fitness ? population[a] : population[b];
+		int c = rng.rndInt(GENETIC_POPULATION);
+		const GeneticCandidate & p2 = population[c];
+
+		//Uniform crossover
+		for(int bi = 0; bi < GENETIC_MAX_BLOCKS; bi++){
+			child.mapping[bi] = bi >= blockSpace ? -1 : rng.uniform() < 0.5f ? p1.mapping[bi] : p2.mapping[bi];
+		}
+
+		//Mutate a run of blocks, same shape as the random evolution
+		int inBlock = rng.rndInt(blockCount);
+		int outBlock = rng.uniform() < 0.3f ? -1 : rng.rndInt(blockSpace);
+		child.mapping[inBlock] = outBlock;
+		while(outBlock != -1 && rng.uniform() < 0.5f){
+			outBlock++;
+			inBlock++;
+			if(outBlock >= blockSpace || inBlock >= blockSpace) break;
+			child.mapping[inBlock] = outBlock;
+		}
+
+		child.fitness = scoreMapping(pattern, child.mapping, blockCount, settings);
+		candidates++;
+
+		if(child.fitness >= population[worst].fitness){
+			population[worst] = child;
+			if(child.fitness > population[bestIndex].fitness) bestIndex = worst;
+			for(int pi = 0; pi < GENETIC_POPULATION; pi++){
+				if(population[pi].fitness < population[worst].fitness) worst = pi;
+			}
+		}
+	}while(clock::now() < deadline);
+
+	best = population[bestIndex];
+	lastCandidates = candidates;
+	lastFitness = best.fitness;
+	return candidates;
+}
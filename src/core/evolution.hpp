@@ -0,0 +1,144 @@
+#pragma once
+
+#include "noteBlock.hpp"
+#include "random.hpp"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define GENETIC_MAX_BLOCKS CHAIN_MAX_BLOCKS
+#define GENETIC_POPULATION 16
+
+enum EvolutionMode{
+	EM_RANDOM,
+	EM_GENETIC,
+};
+
+//Block remapping applied on top of the pattern while evolution is on. -1 plays the block itself.
+struct BlockEvolution{
+	int evolutionMapping [CHAIN_MAX_BLOCKS];
+	int randomEvolution [CHAIN_MAX_BLOCKS];
+	bool evolveUpOrDownBias;
+	int blockSpace = CORE_MAX_BLOCKS; //Blocks a mapping can point at, the whole chain when modules are chained
+
+	BlockEvolution(){
+		clear();
+	}
+
+	void clear();
+	void clearRandom();
+	//remap gives the new index of each block of the old space, -1 once it is gone. Without it blocks keep their
+	//index. Mappings from or to a block that is gone are dropped, the rest carry over.
+	void setBlockSpace(int blocks, const int* remap = NULL);
+
+	//Called each time the sequence loops while evolution is on
+	void evolve(int maxBlock, CoreRandom & rng);
+	void addEvolution(int maxBlock, CoreRandom & rng);
+	void removeEvolution(int maxBlock, CoreRandom & rng);
+
+	//Returns the pulse to play in place of pulse
+	int mapPulse(int pulse) const;
+};
+
+//Weights are 0-1, 0 turns that fitness function off
+struct GeneticSettings{
+	float scaleWeight = 1.f;
+	float smoothWeight = 1.f;
+	float densityWeight = 0.5f;
+	float densityTarget = 2.f; //Sounding notes per block
+	int scale = 0; //Index into SCALES
+	int root = 0; //Semitones above C
+	float budgetMs = 2.f; //Worker time per loop
+};
+
+struct GeneticCandidate{
+	int mapping [GENETIC_MAX_BLOCKS];
+	float fitness;
+};
+
+float scoreMapping(const NoteBlockPattern & pattern, const int * mapping, int blockCount, const GeneticSettings & settings);
+
+//Evolves block mappings on a worker thread. The audio thread requests a generation when the sequence
+//loops and picks up the best mapping on the next loop without locking.
+struct GeneticEvolver{
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<bool> fresh;
+	GeneticCandidate best;
+
+	//Pattern snapshot handed over by the audio thread, only written while requested is false
+	std::atomic<bool> requested;
+	NoteBlockPattern requestPattern;
+	int requestBlocks = 0;
+	int requestSpace = CORE_MAX_BLOCKS;
+
+	//The worker sleeps on wake until there is a request to work on or it is stopped
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	//Written by the UI, copied by the worker at the start of each generation
+	std::mutex settingsMutex;
+	GeneticSettings settings;
+
+	//The best mapping of the last generation, so the UI can preview it before the audio thread takes it
+	std::atomic<int> candidateView [GENETIC_MAX_BLOCKS];
+
+	//Stats from the last generation for the context menu
+	std::atomic<int> lastCandidates;
+	std::atomic<float> lastFitness;
+
+	GeneticCandidate population [GENETIC_POPULATION];
+	bool populationReady = false;
+	int populationSpace = 0; //Block space the population was seeded for
+	CoreRandom rng;
+
+	GeneticEvolver(){
+		running = false;
+		fresh = false;
+		requested = false;
+		lastCandidates = 0;
+		lastFitness = 0;
+		for(int bi = 0; bi < GENETIC_MAX_BLOCKS; bi++){
+			candidateView[bi].store(-1, std::memory_order_relaxed);
+		}
+	}
+	~GeneticEvolver(){
+		stop();
+	}
+
+	void start(uint64_t seed);
+	void stop();
+
+	GeneticSettings getSettings();
+	void setSettings(const GeneticSettings & settings);
+
+	//Audio thread, skipped while the worker hasn't picked up the last request
+	void request(const NoteBlockPattern & pattern, int blockCount, int blockSpace = CORE_MAX_BLOCKS){
+		if(requested.load(std::memory_order_acquire)) return;
+		requestPattern = pattern;
+		requestBlocks = blockCount;
+		requestSpace = blockSpace;
+		requested.store(true, std::memory_order_release);
+		//Without the lock, which the audio thread can't wait on. The worker's wait timeout covers the rare
+		//notify that lands between its check and its wait.
+		wake.notify_one();
+	}
+	//Audio thread, returns true when a new best mapping was published since the last call
+	bool takeBest(int * mapping){
+		if(!fresh.load(std::memory_order_acquire)) return false;
+		for(int bi = 0; bi < GENETIC_MAX_BLOCKS; bi++){
+			mapping[bi] = best.mapping[bi];
+		}
+		fresh.store(false, std::memory_order_release);
+		return true;
+	}
+
+	//Runs one generation for up to the time budget and returns the number of candidates scored.
+	//Safe to call directly without the worker thread, which is how it can be benchmarked.
+	//blockSpace is how many blocks a mapping can point at.
+	int runGeneration(const NoteBlockPattern & pattern, int blockCount, const GeneticSettings & settings, int blockSpace = CORE_MAX_BLOCKS);
+
+	void run();
+};
@@ -0,0 +1,43 @@
+#include "groove.hpp"
+
+const char* GROOVE_TEMPLATE_NAMES [GROOVE_TEMPLATE_COUNT] = {"Off","Swing 54%","Swing 58%","Swing 62%","Swing 66%","Swing 71%","Swing 75%","Custom"};
+
+static const float SWING_PERCENT [GROOVE_TEMPLATE_COUNT] = {50, 54, 58, 62, 66, 71, 75, 50};
+
+static float clampOffset(float offset){
+	if(offset != offset) return 0;
+	if(offset < -NOTE_TIMING_MAX) return -NOTE_TIMING_MAX;
+	if(offset > NOTE_TIMING_MAX) return NOTE_TIMING_MAX;
+	return offset;
+}
+
+void swingOffsets(float percent, float * stepOffsets){
+	const float SIXTEENTH = PULSES_PER_BLOCK / GROOVE_STEPS;
+	float late = clampOffset(percent / 100.f * SIXTEENTH * 2 - SIXTEENTH);
+	for(int si = 0; si < GROOVE_STEPS; si++){
+		stepOffsets[si] = si % 2 == 1 ? late : 0;
+	}
+}
+
+void grooveTemplateOffsets(int templateId, const float * customOffsets, float * stepOffsets){
+	if(templateId == GROOVE_CUSTOM){
+		for(int si = 0; si < GROOVE_STEPS; si++){
+			stepOffsets[si] = clampOffset(customOffsets[si]);
+		}
+		return;
+	}
+	if(templateId < 0 || templateId >= GROOVE_TEMPLATE_COUNT) templateId = GROOVE_OFF;
+	swingOffsets(SWING_PERCENT[templateId], stepOffsets);
+}
+
+void buildGrooveMap(const float * stepOffsets, GrooveMap & map){
+	const int SIXTEENTH = PULSES_PER_BLOCK / GROOVE_STEPS;
+	for(int pi = 0; pi < PULSES_PER_BLOCK; pi++){
+		int si = pi / SIXTEENTH;
+		//The block repeats, so the sixteenth after the last is the next block's first
+		float from = stepOffsets[si];
+		float to = stepOffsets[(si + 1) % GROOVE_STEPS];
+		float t = (pi - si * SIXTEENTH) / (float) SIXTEENTH;
+		map.offset[pi] = from + (to - from) * t;
+	}
+}
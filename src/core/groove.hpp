@@ -0,0 +1,37 @@
+#pragma once
+
+#include "noteBlock.hpp"
+
+//Swing and groove as a timing map over the pulse grid of a block. Maps are built off the audio thread and
+//swapped in whole, so playing a groove costs one table lookup per timeline event.
+
+#define GROOVE_STEPS 4 //Sixteenths in a block
+#define PULSES_PER_BAR (PULSES_PER_BLOCK * 4)
+
+enum GrooveTemplateId{
+	GROOVE_OFF,
+	GROOVE_SWING_54,
+	GROOVE_SWING_58,
+	GROOVE_SWING_62,
+	GROOVE_SWING_66,
+	GROOVE_SWING_71,
+	GROOVE_SWING_75,
+	GROOVE_CUSTOM,
+	GROOVE_TEMPLATE_COUNT
+};
+
+extern const char* GROOVE_TEMPLATE_NAMES [GROOVE_TEMPLATE_COUNT];
+
+struct GrooveMap{
+	float offset [PULSES_PER_BLOCK]; //Pulses to move an event on each pulse of the block, 0 is straight
+};
+
+//MPC style swing, the off beat sixteenths land at percent of an eighth note. 50 is straight, 66 is close to triplets.
+void swingOffsets(float percent, float * stepOffsets);
+
+//Fills GROOVE_STEPS offsets in pulses for a template. Custom copies customOffsets, clamped to NOTE_TIMING_MAX.
+void grooveTemplateOffsets(int templateId, const float * customOffsets, float * stepOffsets);
+
+//Interpolates between the sixteenths so notes starting in between move with the notes around them.
+//The timeline shifts every change of a note by the offset at its start, so notes keep their length.
+void buildGrooveMap(const float * stepOffsets, GrooveMap & map);
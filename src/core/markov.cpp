@@ -0,0 +1,191 @@
+#include "markov.hpp"
+#include <cmath>
+#include <algorithm>
+
+//Picks an index weighted by row. Returns -1 if the row is empty.
+static int sampleRow(const float * row, int size, float u){
+	float total = 0;
+	for(int i = 0; i < size; i++) total += row[i];
+	if(total <= 0) return -1;
+	float target = u * total;
+	for(int i = 0; i < size; i++){
+		target -= row[i];
+		if(target < 0) return i;
+	}
+	return size - 1;
+}
+
+//Picks from the row, falling back to the column totals when this state was never seen
+template <int SIZE>
+static int sampleTransition(const float (&table) [SIZE][SIZE], int from, float u){
+	int to = sampleRow(table[from], SIZE, u);
+	if(to != -1) return to;
+	float totals [SIZE] = {};
+	for(int r = 0; r < SIZE; r++){
+		for(int c = 0; c < SIZE; c++){
+			totals[c] += table[r][c];
+		}
+	}
+	return sampleRow(totals, SIZE, u);
+}
+
+void MarkovModel::clear(){
+	for(int i = 0; i < MARKOV_INTERVALS; i++){
+		for(int j = 0; j < MARKOV_INTERVALS; j++){
+			intervalCounts[i][j] = 0;
+		}
+	}
+	for(int i = 0; i < MARKOV_SUBDIVS; i++){
+		for(int j = 0; j < MARKOV_SUBDIVS; j++){
+			subdivCounts[i][j] = 0;
+		}
+	}
+	noteCount = 0;
+	muteCount = 0;
+	tieChances = 0;
+	tieCount = 0;
+	patternsLearned = 0;
+}
+
+void MarkovModel::learn(const std::vector<NoteBlock> & pattern){
+	int prevSubdiv = 0;
+	int prevInterval = MARKOV_MAX_INTERVAL;
+	bool hasPrevCV = false;
+	float prevCV = 0;
+
+	for(size_t bi = 0; bi < pattern.size(); bi++){
+		const NoteBlock & block = pattern[bi];
+		subdivCounts[prevSubdiv][block.subdivision]++;
+		prevSubdiv = block.subdivision;
+
+		int last = lastNoteIndex(block.subdivision);
+		for(int ni = 0; ; ni = nextNoteIndex(block.subdivision, ni)){
+			noteCount++;
+			if(ni == 0 && bi > 0){
+				tieChances++;
+				if(block.extra[ni] == NE_TIE) tieCount++;
+			}
+			if(block.extra[ni] == NE_MUTE) muteCount++;
+
+			//Muted and tied notes hold the previous CV so they don't count as a melodic step
+			if(block.extra[ni] == NE_NONE){
+				if(hasPrevCV){
+					int interval = std::min(std::max((int) std::round((block.cv[ni] - prevCV) * 12), -MARKOV_MAX_INTERVAL), MARKOV_MAX_INTERVAL);
+					int state = interval + MARKOV_MAX_INTERVAL;
+					intervalCounts[prevInterval][state]++;
+					prevInterval = state;
+				}
+				prevCV = block.cv[ni];
+				hasPrevCV = true;
+			}
+
+			if(ni >= last) break;
+		}
+	}
+	patternsLearned++;
+}
+
+void MarkovModel::merge(const MarkovModel & other){
+	for(int i = 0; i < MARKOV_INTERVALS; i++){
+		for(int j = 0; j < MARKOV_INTERVALS; j++){
+			intervalCounts[i][j] += other.intervalCounts[i][j];
+		}
+	}
+	for(int i = 0; i < MARKOV_SUBDIVS; i++){
+		for(int j = 0; j < MARKOV_SUBDIVS; j++){
+			subdivCounts[i][j] += other.subdivCounts[i][j];
+		}
+	}
+	noteCount += other.noteCount;
+	muteCount += other.muteCount;
+	tieChances += other.tieChances;
+	tieCount += other.tieCount;
+	patternsLearned += other.patternsLearned;
+}
+
+std::vector<NoteBlock> MarkovModel::generate(int blockCount, float startCV, CoreRandom & rng) const{
+	std::vector<NoteBlock> pattern(blockCount);
+
+	float muteOdds = noteCount > 0 ? muteCount / noteCount : 0;
+	float tieOdds = tieChances > 0 ? tieCount / tieChances : 0;
+
+	int subdiv = 0;
+	int interval = MARKOV_MAX_INTERVAL;
+	float cv = startCV;
+	bool first = true;
+
+	for(int bi = 0; bi < blockCount; bi++){
+		NoteBlock & block = pattern[bi];
+
+		int nextSubdiv = sampleTransition(subdivCounts, subdiv, rng.uniform());
+		//The start state is never a destination, so treat it like an unknown pattern
+		subdiv = nextSubdiv > 0 ? nextSubdiv : SubDiv_Quarter;
+		block.subdivision = subdiv;
+
+		for(int ni = 0; ni < 4; ni++){
+			block.extra[ni] = NE_NONE;
+		}
+
+		bool active [4] = {};
+		int last = lastNoteIndex(subdiv);
+		for(int ni = 0; ; ni = nextNoteIndex(subdiv, ni)){
+			active[ni] = true;
+			if(ni == 0 && bi > 0 && rng.uniform() < tieOdds){
+				block.extra[ni] = NE_TIE;
+			}else if(rng.uniform() < muteOdds){
+				block.extra[ni] = NE_MUTE;
+			}else{
+				if(!first){
+					int nextInterval = sampleTransition(intervalCounts, interval, rng.uniform());
+					if(nextInterval != -1) interval = nextInterval;
+					float step = (interval - MARKOV_MAX_INTERVAL) / 12.f;
+					//Bounce off the edges of the keyboard rather than clamping so the contour is kept
+					if(cv + step > NOTE_CV_MAX || cv + step < NOTE_CV_MIN) step = -step;
+					cv = std::min(std::max(cv + step, NOTE_CV_MIN), NOTE_CV_MAX);
+				}
+				first = false;
+			}
+			block.cv[ni] = cv;
+
+			if(ni >= last) break;
+		}
+
+		//Unused slots copy the note before them so switching subdivision later doesn't reveal stale notes
+		for(int ni = 1; ni < 4; ni++){
+			if(!active[ni]) block.cv[ni] = block.cv[ni - 1];
+		}
+	}
+
+	return pattern;
+}
+
+bool MarkovGenerator::start(const std::vector<NoteBlock> & source, const MarkovModel & library, int blockCount, uint64_t seed){
+	if(busy) return false;
+	if(worker.joinable()) worker.join();
+	busy = true;
+	ready = false;
+
+	//The worker gets its own copies so the UI can keep editing while it runs
+	CoreRandom rng;
+	rng.seed(seed, ~seed);
+	MarkovModel model = library;
+	std::vector<NoteBlock> pattern = source;
+
+	worker = std::thread([this, model, pattern, blockCount, rng]() mutable {
+		model.learn(pattern);
+		float startCV = 0;
+		if(pattern.size() > 0) startCV = pattern[0].cv[0];
+		result = model.generate(blockCount, startCV, rng);
+		ready = true;
+	});
+	return true;
+}
+
+bool MarkovGenerator::poll(std::vector<NoteBlock> & out){
+	if(!ready) return false;
+	if(worker.joinable()) worker.join();
+	out.swap(result);
+	ready = false;
+	busy = false;
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "noteBlock.hpp"
+#include "random.hpp"
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#define MARKOV_MAX_INTERVAL 12
+#define MARKOV_INTERVALS (MARKOV_MAX_INTERVAL * 2 + 1)
+#define MARKOV_SUBDIVS 8 //0 is the start state, 1-7 are the subdivision types
+
+//Interval and rhythm transition counts learned from one or more patterns
+struct MarkovModel{
+	float intervalCounts [MARKOV_INTERVALS][MARKOV_INTERVALS];
+	float subdivCounts [MARKOV_SUBDIVS][MARKOV_SUBDIVS];
+	float noteCount;
+	float muteCount;
+	float tieChances;
+	float tieCount;
+	int patternsLearned;
+
+	MarkovModel(){
+		clear();
+	}
+
+	void clear();
+	void learn(const std::vector<NoteBlock> & pattern);
+	void merge(const MarkovModel & other);
+	std::vector<NoteBlock> generate(int blockCount, float startCV, CoreRandom & rng) const;
+};
+
+//Samples a new pattern on a worker thread. The UI thread starts a job and polls for the result.
+struct MarkovGenerator{
+	std::thread worker;
+	std::atomic<bool> busy;
+	std::atomic<bool> ready;
+	std::vector<NoteBlock> result;
+
+	MarkovGenerator(){
+		busy = false;
+		ready = false;
+	}
+	~MarkovGenerator(){
+		if(worker.joinable()) worker.join();
+	}
+
+	//Learns from the source pattern merged with the library. Returns false if a job is still running.
+	bool start(const std::vector<NoteBlock> & source, const MarkovModel & library, int blockCount, uint64_t seed);
+
+	//Returns true once with the finished pattern
+	bool poll(std::vector<NoteBlock> & out);
+};
@@ -0,0 +1,186 @@
+#include "noteBlock.hpp"
+#include <cmath>
+
+//Clamps before converting, a float outside int's range or NaN has no defined conversion
+static int paramToInt(float value, int low, int high){
+	if(!(value >= low)) return low;
+	if(value > high) return high;
+	return static_cast<int>(value);
+}
+
+NoteBlock readNoteBlock(const float * blockParams){
+	NoteBlock block;
+	block.subdivision = paramToInt(blockParams[0], 1, 7);
+	for(int ni = 0; ni < 4; ni++){
+		float cv = blockParams[1 + ni * 2];
+		block.cv[ni] = std::isfinite(cv) ? cv : 0;
+		int extra = paramToInt(blockParams[2 + ni * 2], NE_NONE, NE_TIE);
+		block.extra[ni] = (extra == NE_MUTE || extra == NE_TIE) ? static_cast<NoteExtra>(extra) : NE_NONE;
+		block.timing[ni] = 0;
+	}
+	return block;
+}
+
+void writeNoteBlock(const NoteBlock & block, float * blockParams){
+	blockParams[0] = block.subdivision;
+	for(int ni = 0; ni < 4; ni++){
+		blockParams[1 + ni * 2] = block.cv[ni];
+		blockParams[2 + ni * 2] = block.extra[ni];
+	}
+}
+
+int getNoteIndexForPulse(int blockType, int pulseInBlock){
+	switch(blockType){
+		//Whole Note
+		case 1:
+		default:
+			return 0;
+
+		//Half Notes
+		case 2:
+			return (pulseInBlock / 12) * 2;
+
+		//Quater - Quater - Half
+		case 3:
+			if(pulseInBlock >= 12) return 2;
+			return pulseInBlock / 6;
+
+		//Quater - Half - Quarter
+		case 4:
+			if(pulseInBlock >= 18) return 3;
+			else if(pulseInBlock >= 6) return 1;
+			return 0;
+
+		//Half - Quarter - Quarter
+		case 5:
+			if(pulseInBlock < 12) return 0;
+			return pulseInBlock / 6;
+
+		//Tipplets
+		case 6:
+			return pulseInBlock / 8;
+
+		//Quarter Notes
+		case 7:
+			return pulseInBlock / 6;
+	}
+}
+
+bool getGateHigh(int blockType, int pulseInBlock){
+	switch(blockType){
+		//Whole Note
+		case 1:
+		default:
+			return 0 == (pulseInBlock / 12);
+
+		//Half Notes
+		case 2:
+			return 0 == ((pulseInBlock / 6) % 2);
+
+		//Quater - Quater - Half
+		case 3:
+			if(pulseInBlock >= 12) return pulseInBlock < 18;
+			return 0 == ((pulseInBlock / 3) % 2);
+
+		//Quater - Half - Quarter
+		case 4:
+			if(pulseInBlock >= 18) return pulseInBlock < 21;
+			else if(pulseInBlock >= 6) return pulseInBlock < 12;
+			return pulseInBlock < 3;
+
+		//Half - Quarter - Quarter
+		case 5:
+			if(pulseInBlock < 12) return pulseInBlock < 6;
+			return 0 == ((pulseInBlock / 3) % 2);
+
+		//Tipplets
+		case 6:
+			return 0 == ((pulseInBlock / 4) % 2);
+
+		//Quarter Notes
+		case 7:
+			return 0 == ((pulseInBlock / 3) % 2);
+	}
+}
+
+int lastNoteIndex(int blockType){
+	return getNoteIndexForPulse(blockType,PULSES_PER_BLOCK - 1);
+}
+
+int nextNoteIndex(int blockType, int noteIndex){
+	switch(blockType){
+		//Half Notes
+		case 2:
+			return noteIndex + 2;
+
+		//Quater - Half - Quarter
+		case 4:
+			if(noteIndex == 1) return 3;
+			break;
+
+		//Half - Quarter - Quarter
+		case 5:
+			if(noteIndex == 0) return 2;
+			break;
+	}
+	return noteIndex + 1;
+}
+
+void getNoteAndBlock(const NoteBlockPattern & pattern, int pulse, int& block, int& noteIndex){
+	if(pulse < 0 || pulse >= pattern.blockCount * PULSES_PER_BLOCK){
+		block = -1;
+		noteIndex = -1;
+		return;
+	}
+	block = pulse / PULSES_PER_BLOCK;
+	int pulseInBlock = pulse - block * PULSES_PER_BLOCK;
+	noteIndex = getNoteIndexForPulse(pattern.blocks[block].subdivision,pulseInBlock);
+}
+
+void getOutputValues(const NoteBlockPattern & pattern, int pulse, float& cv, bool& updateCV, bool& gateHigh)
+{	
+	if(pulse < 0 || pulse >= pattern.blockCount * PULSES_PER_BLOCK){
+		cv = 0;
+		updateCV = false;
+		gateHigh = false;
+		return;
+	}
+	int block = pulse / PULSES_PER_BLOCK;
+	int pulseInBlock = pulse - block * PULSES_PER_BLOCK;
+	const NoteBlock & noteBlock = pattern.blocks[block];
+	int noteIndex = getNoteIndexForPulse(noteBlock.subdivision,pulseInBlock);
+
+	cv = noteBlock.cv[noteIndex];
+	NoteExtra extra = noteBlock.extra[noteIndex];
+	updateCV = extra == NE_NONE;
+	if(extra == NE_MUTE){
+		gateHigh = false;
+	}else{
+		//Check for Tie in next note
+		int block2 = block;
+		int noteIndex2 = noteIndex;
+		getNextNote(pattern,block2,noteIndex2);
+		bool nextIsTie = block2 < pattern.blockCount && NE_TIE == pattern.blocks[block2].extra[noteIndex2];
+		if(nextIsTie){
+			gateHigh = true;
+		}else{
+			gateHigh = getGateHigh(noteBlock.subdivision,pulseInBlock);
+		}
+	}
+
+}
+
+void getNextNote(const NoteBlockPattern & pattern, int& block, int& noteIndex){
+	if(block < 0 || block >= pattern.blockCount){
+		block = pattern.blockCount;
+		noteIndex = 0;
+		return;
+	}
+	int blockType = pattern.blocks[block].subdivision;
+	if(lastNoteIndex(blockType) <= noteIndex){
+		block++;
+		noteIndex=0;
+	}else{
+		noteIndex = nextNoteIndex(blockType,noteIndex);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+//Note block layout and evaluation for Sequencer3. Works on plain data so it can run without the Rack SDK.
+
+#define CORE_MAX_BLOCKS 16 //On one module
+#define CHAIN_MAX_MODULES 4 //Sequencer3s that can play as one long sequence
+#define CHAIN_MAX_BLOCKS (CORE_MAX_BLOCKS * CHAIN_MAX_MODULES)
+#define PULSES_PER_BLOCK 24 //24 Pulses per Quarter Note
+#define NOTE_BLOCK_PARAM_COUNT 9 //Subdivision then CV and Extra for each of the 4 notes
+
+#define ROOT_OFFSET 7.f/12.f
+#define NOTE_CV_MIN (-1.f - ROOT_OFFSET)
+#define NOTE_CV_MAX (2.f - ROOT_OFFSET - 1.f/12.f)
+#define NOTE_TIMING_MAX 3.f //Microtiming limit in pulses either side of the grid, half a sixteenth
+
+enum NoteExtra{
+	NE_NONE,
+	NE_MUTE,
+	NE_TIE,
+};
+
+const int SubDiv_Quarter = 1;
+const int SubDiv_Eighth = 2;
+const int SubDiv_Quarter_Quarter_Half = 3;
+const int SubDiv_Quarter_Half_Quarter = 4;
+const int SubDiv_Half_Quarter_Quarter = 5;
+const int SubDiv_Tipplets = 6;
+const int SubDiv_Sixteenth = 7;
+
+struct NoteBlock{
+	int subdivision;
+	float cv [4];
+	NoteExtra extra [4];
+	float timing [4]; //Microtiming in pulses, negative plays early. Kept in separate params from the rest of the block.
+};
+
+//The blocks a sequencer can play, sized for a whole chain. blockCount is how many are filled in, not the sequence length.
+struct NoteBlockPattern{
+	NoteBlock blocks [CHAIN_MAX_BLOCKS];
+	int blockCount = 0;
+};
+
+//Reads a block from its NOTE_BLOCK_PARAM_COUNT param values, with the notes on the grid
+NoteBlock readNoteBlock(const float * blockParams);
+void writeNoteBlock(const NoteBlock & block, float * blockParams);
+
+int getNoteIndexForPulse(int blockType, int pulseInBlock);
+
+bool getGateHigh(int blockType, int pulseInBlock);
+
+int lastNoteIndex(int blockType);
+
+int nextNoteIndex(int blockType, int noteIndex);
+
+void getNoteAndBlock(const NoteBlockPattern & pattern, int pulse, int & block, int & noteIndex);
+
+void getOutputValues(const NoteBlockPattern & pattern, int pulse, float& cv, bool& updateCV, bool& gateHigh);
+
+//Steps to the note after block/noteIndex. block can end up at pattern.blockCount when stepping off the end.
+void getNextNote(const NoteBlockPattern & pattern, int& block, int& noteIndex);
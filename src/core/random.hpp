@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+//xoroshiro128+ so the core can be seeded and run on any thread without the Rack SDK
+struct CoreRandom{
+	uint64_t state [2] = {0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull};
+
+	void seed(uint64_t s0, uint64_t s1){
+		state[0] = s0;
+		state[1] = s1;
+		if(state[0] == 0 && state[1] == 0) state[1] = 1;
+		//Warm up so similar seeds diverge
+		for(int i = 0; i < 8; i++) next();
+	}
+
+	uint64_t next(){
+		uint64_t s0 = state[0];
+		uint64_t s1 = state[1];
+		uint64_t result = s0 + s1;
+		s1 ^= s0;
+		state[0] = ((s0 << 55) | (s0 >> 9)) ^ s1 ^ (s1 << 14);
+		state[1] = (s1 << 36) | (s1 >> 28);
+		return result;
+	}
+
+	//[0, 1)
+	float uniform(){
+		return (next() >> 40) / 16777216.f;
+	}
+
+	int rndInt(int max){
+		return std::floor(uniform() * max);
+	}
+};
@@ -0,0 +1,110 @@
+#include "render.hpp"
+#include <cstdio>
+#include <cmath>
+#include <sstream>
+
+static float clockVoltage(const RenderSettings & settings, long i){
+	return (i % settings.clockPeriod) < settings.clockWidth ? 10.f : 0.f;
+}
+
+static float resetVoltage(const RenderSettings & settings, long i){
+	return (settings.resetAt >= 0 && i >= settings.resetAt && i < settings.resetAt + settings.clockWidth) ? 10.f : 0.f;
+}
+
+static float fromVoltage(long from, long i){
+	return from >= 0 && i >= from ? 10.f : 0.f;
+}
+
+void renderNoteBlockSequencer(const NoteBlockPattern & pattern, const RenderSettings & settings, EventRecorder & recorder){
+	NoteBlockSequencer seq;
+	seq.rng.seed(settings.seed, ~settings.seed);
+	seq.setSampleRate(1.f / settings.sampleTime);
+	seq.setPpqn(settings.ppqn);
+	buildGrooveMap(settings.groove, seq.groove);
+	seq.gate = settings.gate;
+	seq.reset.window = settings.resetWindow;
+
+	float cv = 0;
+	float gate = 0;
+	for(long i = 0; i < settings.samples; i++){
+		if(seq.tick(clockVoltage(settings, i), resetVoltage(settings, i), settings.sampleTime)){
+			NoteBlockOutput out;
+			if(seq.advance(pattern, settings.seqLength, settings.evolveOn, out)){
+				if(out.updateCV) cv = out.cv;
+				gate = out.gateHigh ? 10.f : 0.f;
+			}
+		}
+		if(seq.isRunning() && seq.gateEnd()){
+			gate = 0.f;
+		}
+		recorder.record(i, 0, gate);
+		recorder.record(i, 1, cv);
+	}
+}
+
+void renderEvolvingStepSequencer(const StepPattern & pattern, const float* cv, const RenderSettings & settings, EventRecorder & recorder){
+	EvolvingStepSequencer seq;
+	seq.rng.seed(settings.seed, ~settings.seed);
+	seq.reset.window = settings.resetWindow;
+
+	float out = 0;
+	for(long i = 0; i < settings.samples; i++){
+		if(seq.tick(clockVoltage(settings, i), resetVoltage(settings, i), settings.sampleTime)){
+			seq.advance(pattern);
+		}
+		int step = seq.outputStep();
+		if(step >= 0) out = cv[step];
+		recorder.record(i, 0, seq.gateHigh() ? 10.f : 0.f);
+		recorder.record(i, 1, out);
+	}
+}
+
+void renderRetrogradeStepSequencer(const StepPattern & pattern, const float* cv, const RenderSettings & settings, EventRecorder & recorder){
+	RetrogradeStepSequencer seq;
+	seq.reset.window = settings.resetWindow;
+
+	float out = 0;
+	for(long i = 0; i < settings.samples; i++){
+		float retrograde = fromVoltage(settings.retrogradeFrom, i);
+		float inversion = fromVoltage(settings.inversionFrom, i);
+		if(seq.tick(clockVoltage(settings, i), resetVoltage(settings, i), retrograde, inversion, settings.sampleTime)){
+			seq.advance(pattern);
+		}
+		if(!seq.muted){
+			int step = seq.outputStep();
+			out = seq.transform(step >= 0 ? cv[step] : 0, cv[0]);
+		}
+		recorder.record(i, 0, seq.gateHigh() ? 10.f : 0.f);
+		recorder.record(i, 1, out);
+	}
+}
+
+std::string formatEvents(const std::vector<OutputEvent> & events){
+	std::string text;
+	char line [64];
+	for(const OutputEvent & e : events){
+		snprintf(line, sizeof(line), "%ld %d %.6g\n", e.sample, e.output, e.value);
+		text += line;
+	}
+	return text;
+}
+
+bool parseEvents(const std::string & text, std::vector<OutputEvent> & events){
+	events.clear();
+	std::istringstream in(text);
+	OutputEvent e;
+	while(in >> e.sample >> e.output >> e.value){
+		if(e.output < 0 || e.output > 1) return false;
+		events.push_back(e);
+	}
+	return in.eof();
+}
+
+int compareEvents(const std::vector<OutputEvent> & a, const std::vector<OutputEvent> & b, float tolerance){
+	size_t count = a.size() < b.size() ? a.size() : b.size();
+	for(size_t i = 0; i < count; i++){
+		if(a[i].sample != b[i].sample || a[i].output != b[i].output || std::abs(a[i].value - b[i].value) > tolerance) return i;
+	}
+	if(a.size() != b.size()) return count;
+	return -1;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "sequencer.hpp"
+#include "stepSequencer.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+
+//Offline rendering of the core so output streams can be captured and compared without Rack
+
+//One change on an output. Only changes are kept so a bar of audio is a handful of events.
+struct OutputEvent{
+	long sample;
+	int output; //0 = gate, 1 = cv
+	float value;
+};
+
+struct EventRecorder{
+	std::vector<OutputEvent> events;
+	float last [2] = {NAN, NAN};
+
+	void record(long sample, int output, float value){
+		if(value == last[output]) return;
+		last[output] = value;
+		events.push_back({sample, output, value});
+	}
+};
+
+//A fixed square clock and an optional reset pulse
+struct RenderSettings{
+	long samples = 48000 * 8;
+	int clockPeriod = 24000; //Samples per quarter note
+	int clockWidth = 100;
+	long resetAt = -1; //Sample to send a reset trigger on, -1 for none
+	float resetWindow = 0; //Seconds, see ResetScheduler
+	float sampleTime = 1.f / 48000;
+	int seqLength = 8;
+	int ppqn = PULSES_PER_BLOCK;
+	float groove [GROOVE_STEPS] = {}; //Pulses to move each sixteenth
+	GateSettings gate;
+	bool evolveOn = false;
+	uint64_t seed = 1; //Only the random evolution mode is deterministic, genetic runs against a time budget
+	long retrogradeFrom = -1; //Sample the retrograde input goes high on, -1 for never
+	long inversionFrom = -1;
+};
+
+void renderNoteBlockSequencer(const NoteBlockPattern & pattern, const RenderSettings & settings, EventRecorder & recorder);
+
+//The step sequencers record each step's cv as is, the modules map it through their CV range afterwards
+void renderEvolvingStepSequencer(const StepPattern & pattern, const float* cv, const RenderSettings & settings, EventRecorder & recorder);
+void renderRetrogradeStepSequencer(const StepPattern & pattern, const float* cv, const RenderSettings & settings, EventRecorder & recorder);
+
+//One event per line as "sample output value"
+std::string formatEvents(const std::vector<OutputEvent> & events);
+bool parseEvents(const std::string & text, std::vector<OutputEvent> & events);
+
+//Returns the index of the first event that differs, or -1 when the streams match
+int compareEvents(const std::vector<OutputEvent> & a, const std::vector<OutputEvent> & b, float tolerance = 1e-4f);
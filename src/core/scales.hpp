@@ -1,3 +1,8 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
 #define NUM_OF_SCALES 12
 static std::vector<int> SCALES[NUM_OF_SCALES] = {
 	std::vector<int>({1,3,5,6,8,10,12}), //Major
@@ -13,3 +18,18 @@ static std::vector<int> SCALES[NUM_OF_SCALES] = {
 	std::vector<int>({1,4,6,8,11}), //Minor Pentatonic
 	std::vector<int>({1,4,6,7,8,11}), //Blues
 };
+
+static const std::string SCALE_LABELS[NUM_OF_SCALES] = {
+	"Major",
+	"Dorian",
+	"Phrygian",
+	"Lydian",
+	"Mixolydian",
+	"Minor",
+	"Locrian",
+	"Harmonic Minor",
+	"Melodic Minor",
+	"Major Pentatonic",
+	"Minor Pentatonic",
+	"Blues",
+};
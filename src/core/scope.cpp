@@ -0,0 +1,22 @@
+#include "scope.hpp"
+
+ScopeRing::ScopeRing(){
+	for(int i = 0; i < SCOPE_PULSES; i++){
+		cv[i].store(0, std::memory_order_relaxed);
+		gate[i].store(false, std::memory_order_relaxed);
+	}
+	written.store(0, std::memory_order_relaxed);
+}
+
+int ScopeRing::read(ScopeSample * out, int count) const{
+	uint32_t end = written.load(std::memory_order_acquire);
+	if(count > SCOPE_PULSES) count = SCOPE_PULSES;
+	if((uint32_t) count > end) count = end;
+	uint32_t start = end - count;
+	for(int i = 0; i < count; i++){
+		uint32_t slot = (start + i) % SCOPE_PULSES;
+		out[i].cv = cv[slot].load(std::memory_order_relaxed);
+		out[i].gate = gate[slot].load(std::memory_order_relaxed);
+	}
+	return count;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "groove.hpp"
+#include <atomic>
+#include <cstdint>
+
+//Recent output history for a panel scope. The audio thread writes once per pulse and the UI copies the newest
+//samples out, neither side locks. A read racing a write can get one slot from the next lap, which only shows as
+//a single stale point in the plot.
+#define SCOPE_PULSES (PULSES_PER_BAR * 4) //The last 4 bars
+
+struct ScopeSample{
+	float cv;
+	bool gate; //High at any point during the pulse
+};
+
+struct ScopeRing{
+	std::atomic<float> cv [SCOPE_PULSES];
+	std::atomic<bool> gate [SCOPE_PULSES];
+	std::atomic<uint32_t> written;
+
+	ScopeRing();
+
+	//Audio thread
+	void push(float cvValue, bool gateValue){
+		uint32_t i = written.load(std::memory_order_relaxed);
+		cv[i % SCOPE_PULSES].store(cvValue, std::memory_order_relaxed);
+		gate[i % SCOPE_PULSES].store(gateValue, std::memory_order_relaxed);
+		written.store(i + 1, std::memory_order_release);
+	}
+
+	//UI thread. Copies up to count of the newest samples into out, oldest first, and returns how many it copied.
+	int read(ScopeSample * out, int count) const;
+};
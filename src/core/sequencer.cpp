@@ -0,0 +1,232 @@
+#include "sequencer.hpp"
+
+static int clampMaxBlock(int maxBlock){
+	if(maxBlock < 1) return 1;
+	if(maxBlock > CHAIN_MAX_BLOCKS) return CHAIN_MAX_BLOCKS;
+	return maxBlock;
+}
+
+void NoteBlockSequencer::initalize(){
+	clock.initalize();
+	tempo.reset();
+	pulses.reset();
+	reset.initalize();
+
+	currentPulse = -1;
+	currentEvolvedPulse = -1;
+
+	currentTick = 0;
+	timeline.eventCount = 0;
+	timeline.cursor = 0;
+	timelinePulseInBlock = 0;
+	//The outputs may not match wherever the playhead is restored to
+	timelineJumped = true;
+	gateSamplesLeft = -1;
+
+	pendingShift = 0;
+	evolveOn = false;
+	evolution.clear();
+	publishMappingView();
+}
+
+bool NoteBlockSequencer::tick(float clockVoltage, float resetVoltage, float sampleTime){
+	//Switch resolution where the next tick starts a pulse, so the timeline built for this pulse stays valid
+	int newPpqn = requestedPpqn;
+	if(newPpqn != ppqn && (currentPulse < 0 || currentTick >= ticksPerPulse() - 1)){
+		double ratio = (double) newPpqn / ppqn;
+		pulses.pulseInBeat = (int) (pulses.pulseInBeat * ratio);
+		pulses.pulseRate *= ratio;
+		pulses.pulseCounter = (int) (pulses.pulseCounter / ratio);
+		pulses.wholeSamples = newPpqn == PULSES_PER_BLOCK;
+		ppqn = newPpqn;
+		currentTick = ticksPerPulse() - 1;
+	}
+
+	bool clockEdge = clock.process(clockVoltage);
+	if(clock.startEvent){
+		//Start the pulse grid on this edge with the predicted tempo
+		tempo.period = clock.clockLength;
+		pulses.reset();
+	}
+	if(clockEdge) clockEdge = tempo.process(clock.clockLength);
+
+	//Reset Logic, before the pulse so a reset arriving with a clock edge plays the first pulse on that edge.
+	bool replayClock;
+	int lateSamples = 0;
+	if(reset.process(resetVoltage, clock.edgeEvent, sampleTime, replayClock)){
+		currentPulse = -1;
+		pulses.reset();
+		//The reset belongs to the edge already handled, play its first pulse now with the grid started on that edge
+		if(replayClock) lateSamples = (int) std::round(reset.sinceClock / sampleTime);
+	}
+
+	if(!clock.isRunning()) return false;
+
+	bool pulse = pulses.process(clock.clockLength, clockEdge, tempo, ppqn);
+	pulses.catchUp(lateSamples);
+	return pulse;
+}
+
+bool NoteBlockSequencer::nextTick(){
+	currentTick++;
+	if(currentPulse < 0 || currentTick >= ticksPerPulse()){
+		currentTick = 0;
+		return true;
+	}
+	return false;
+}
+
+void NoteBlockSequencer::setSampleRate(float _sampleRate){
+	if(_sampleRate <= 0) return;
+	if(sampleRate > 0 && sampleRate != _sampleRate){
+		double ratio = (double)_sampleRate / sampleRate;
+		clock.rescale(ratio);
+		tempo.rescale(ratio);
+		pulses.rescale(ratio);
+	}
+	sampleRate = _sampleRate;
+}
+
+bool NoteBlockSequencer::nextPulse(int maxBlock, bool _evolveOn){
+	maxBlock = clampMaxBlock(maxBlock);
+	int maxPulse = maxBlock * PULSES_PER_BLOCK;
+
+	//Incremnt Pulse
+	currentPulse++;
+
+	int shift = pendingShift.exchange(0);
+	if(shift != 0){
+		currentPulse += shift * PULSES_PER_BLOCK;
+		//Shifting can move the playhead off either end, keep it on the same note of the shifted pattern
+		currentPulse = ((currentPulse % maxPulse) + maxPulse) % maxPulse;
+		timelineJumped = true;
+	}else if(currentPulse < 0){
+		//Restored from a patch made with an older shift that could leave the pulse negative
+		currentPulse = 0;
+	}
+
+	if(evolveOn != _evolveOn){
+		evolveOn = _evolveOn;
+		if(evolveOn){
+			//Clear Evolution when the switch is turned on so we get a fresh run
+			evolution.clear();
+			publishMappingView();
+		}
+	}
+
+	//Wrap Pulse
+	bool wrapped = false;
+	if(currentPulse >= maxPulse){
+		currentPulse = 0;
+		wrapped = true;
+	}
+
+	//Swap grooves on bar lines so a bar never plays half of each
+	if(currentPulse % PULSES_PER_BAR == 0 && grooveStaged.load(std::memory_order_acquire)){
+		groove = stagedGroove;
+		grooveStaged.store(false, std::memory_order_release);
+	}
+	return wrapped && evolveOn;
+}
+
+void NoteBlockSequencer::buildTimeline(const NoteBlockPattern & pattern){
+	int pulse = currentPulse;
+
+	if(evolveOn){
+		pulse = evolution.mapPulse(currentPulse);
+		currentEvolvedPulse = currentPulse == pulse ? - 1 : pulse;
+	}else{
+		currentEvolvedPulse = -1;
+	}
+
+	//Rebuilt every pulse so pattern edits are heard as soon as before, the ticks in between only step through it
+	int block = pulse / PULSES_PER_BLOCK;
+	timelinePulseInBlock = pulse - block * PULSES_PER_BLOCK;
+	if(block >= 0 && block < CHAIN_MAX_BLOCKS){
+		blockPulses[block].store(blockPulses[block].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	timeline.build(pattern, block, ticksPerPulse(), groove);
+	timeline.seek(timelinePulseInBlock * ticksPerPulse(), timelineJumped);
+	timelineJumped = false;
+}
+
+int NoteBlockSequencer::gateSamples(int noteLength){
+	double samples;
+	if(gate.mode == GATE_MS){
+		samples = gate.ms * 0.001 * sampleRate;
+	}else{
+		double beat = tempo.isEnabled() && tempo.period > 0 ? tempo.period : clock.clockLength;
+		samples = beat / PULSES_PER_BLOCK * noteLength * gate.percent * 0.01;
+	}
+	//Always at least a sample so the gate is seen
+	if(samples < 1) return 1;
+	return (int) std::round(samples);
+}
+
+bool NoteBlockSequencer::evaluateTick(NoteBlockOutput & out){
+	int tick = timelinePulseInBlock * ticksPerPulse() + currentTick;
+	bool changed = false;
+	while(const TimelineEvent* e = timeline.next(tick)){
+		if(gate.mode != GATE_GRID){
+			//Timed gates end on their own, so only note starts matter
+			if(!e->noteStart) continue;
+			gateSamplesLeft = e->gateHigh && !e->gateHeld ? gateSamples(e->noteLength) : -1;
+		}
+		out.cv = e->cv;
+		out.updateCV = e->updateCV;
+		out.gateHigh = e->gateHigh;
+		changed = true;
+	}
+	return changed;
+}
+
+void NoteBlockSequencer::setEvolutionMode(EvolutionMode mode, uint64_t seed){
+	if(mode == EM_GENETIC) genetic.start(seed);
+	requestedEvolutionMode.store(mode, std::memory_order_release);
+}
+
+void NoteBlockSequencer::evolve(const NoteBlockPattern & pattern, int maxBlock){
+	maxBlock = clampMaxBlock(maxBlock);
+	evolutionMode = static_cast<EvolutionMode>(requestedEvolutionMode.load(std::memory_order_acquire));
+	if(evolutionMode == EM_GENETIC){
+		//Promotes the best mapping the worker found during the last loop and asks for the next generation
+		int mapping [GENETIC_MAX_BLOCKS];
+		if(genetic.takeBest(mapping)){
+			for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+				//The worker may have been searching a chain that has since changed length
+				bool inSpace = bi < evolution.blockSpace && mapping[bi] < evolution.blockSpace;
+				evolution.evolutionMapping[bi] = inSpace ? mapping[bi] : -1;
+			}
+		}
+		evolution.clearRandom();
+		genetic.request(pattern, maxBlock, evolution.blockSpace);
+	}else{
+		evolution.evolve(maxBlock, rng);
+	}
+	publishMappingView();
+}
+
+void NoteBlockSequencer::publishMappingView(){
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		int block = evolution.mapPulse(bi * PULSES_PER_BLOCK) / PULSES_PER_BLOCK;
+		mappingView[bi].store(block == bi ? -1 : block, std::memory_order_relaxed);
+	}
+}
+
+const char* NoteBlockSequencer::checkInvariants(int maxBlock) const{
+	maxBlock = clampMaxBlock(maxBlock);
+	if(currentPulse < -1 || currentPulse >= maxBlock * PULSES_PER_BLOCK) return "currentPulse out of range";
+	if(currentEvolvedPulse < -1 || currentEvolvedPulse >= evolution.blockSpace * PULSES_PER_BLOCK) return "currentEvolvedPulse out of range";
+	if(!isValidPpqn(ppqn) || ppqn % PULSES_PER_BLOCK != 0) return "ppqn not supported";
+	if(currentTick < 0 || currentTick >= ticksPerPulse()) return "currentTick out of range";
+	if(timeline.cursor < 0 || timeline.cursor > timeline.eventCount) return "timeline cursor out of range";
+	//The sample counter only runs at the original resolution without the tempo estimator, the phase does otherwise
+	bool counting = pulses.wholeSamples && !tempo.isEnabled();
+	if(counting && (pulses.pulseCounter < 0 || pulses.pulseCounter > clock.clockLength / ppqn)) return "pulseCounter out of range";
+	if(pulses.pulsePhase < 0 || pulses.pulsePhase > 1) return "pulsePhase out of range";
+	for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+		if(evolution.evolutionMapping[bi] < -1 || evolution.evolutionMapping[bi] >= evolution.blockSpace) return "evolutionMapping out of range";
+		if(evolution.randomEvolution[bi] < -1 || evolution.randomEvolution[bi] >= evolution.blockSpace) return "randomEvolution out of range";
+	}
+	return NULL;
+}
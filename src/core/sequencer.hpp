@@ -0,0 +1,174 @@
+#pragma once
+
+#include "clock.hpp"
+#include "noteBlock.hpp"
+#include "evolution.hpp"
+#include "timeline.hpp"
+#include <atomic>
+#include <cstdint>
+
+struct NoteBlockOutput{
+	float cv;
+	bool updateCV;
+	bool gateHigh;
+};
+
+enum GateMode{
+	GATE_GRID, //Half of each note, on the pulse grid
+	GATE_PERCENT,
+	GATE_MS,
+};
+
+//Timed gates end a number of samples after the note starts rather than on a pulse
+struct GateSettings{
+	GateMode mode = GATE_GRID;
+	float percent = 50; //Of the note length
+	float ms = 10;
+};
+
+//Sequencer3's clock, pulse timeline and evolution without any Rack types.
+//The module feeds it voltages and a pattern snapshot and copies the outputs back.
+struct NoteBlockSequencer{
+	ClockDetector clock;
+	TempoEstimator tempo;
+	PulseClock pulses;
+	ResetScheduler reset;
+
+	float sampleRate; //The rate the clock state is counted in, 0 until known
+
+	int currentPulse;
+	int currentEvolvedPulse;
+
+	int ppqn; //Timeline ticks per block, each pulse of the note grid is ppqn / PULSES_PER_BLOCK ticks
+	std::atomic<int> requestedPpqn; //Set from any thread, switched to on a pulse boundary
+	int currentTick; //Tick within the current pulse
+	BlockTimeline timeline;
+	int timelinePulseInBlock;
+	bool timelineJumped; //The playhead moved somewhere other than the next pulse
+
+	GateSettings gate;
+	int gateSamplesLeft; //Until a timed gate ends, -1 when none is running
+
+	GrooveMap groove; //Audio thread
+	//Handed over by the UI, only written while grooveStaged is false, and taken on the next bar line
+	std::atomic<bool> grooveStaged;
+	GrooveMap stagedGroove;
+
+	//Block shifts requested from the UI, applied on the next pulse
+	std::atomic<int> pendingShift;
+
+	bool evolveOn;
+	EvolutionMode evolutionMode; //Audio thread, takes requestedEvolutionMode on the next loop
+	std::atomic<int> requestedEvolutionMode;
+	BlockEvolution evolution;
+	GeneticEvolver genetic;
+	CoreRandom rng;
+
+	//The block each block plays from after evolution, -1 in place. Published by the audio thread whenever the
+	//evolution changes so the UI can show it without reading the evolution state.
+	std::atomic<int> mappingView [CHAIN_MAX_BLOCKS];
+
+	//Pulses each block has sounded for after evolution. Only the audio thread writes, readers look at the
+	//change since their last read so the counts are never reset.
+	std::atomic<uint32_t> blockPulses [CHAIN_MAX_BLOCKS];
+
+	NoteBlockSequencer(){
+		for(int bi = 0; bi < CHAIN_MAX_BLOCKS; bi++){
+			blockPulses[bi].store(0, std::memory_order_relaxed);
+			mappingView[bi].store(-1, std::memory_order_relaxed);
+		}
+		pendingShift = 0;
+		evolutionMode = EM_RANDOM;
+		requestedEvolutionMode = EM_RANDOM;
+		sampleRate = 0;
+		ppqn = PULSES_PER_BLOCK;
+		requestedPpqn = PULSES_PER_BLOCK;
+		float straight [GROOVE_STEPS] = {};
+		buildGrooveMap(straight, groove);
+		grooveStaged = false;
+		initalize();
+	}
+
+	void initalize();
+
+	//Watches the clock and reset inputs. Returns true when a new timeline tick is due.
+	bool tick(float clockVoltage, float resetVoltage, float sampleTime);
+
+	//Moves to the next tick. On a new pulse it moves to the next pulse, evolving when the sequence wraps, and
+	//rebuilds the block timeline. maxBlock is the playing sequence length in blocks.
+	//Returns true when the outputs change, which out is then set to.
+	bool advance(const NoteBlockPattern & pattern, int maxBlock, bool evolveOn, NoteBlockOutput & out){
+		if(nextTick()){
+			if(nextPulse(maxBlock, evolveOn)) evolve(pattern, maxBlock);
+			buildTimeline(pattern);
+		}
+		return evaluateTick(out);
+	}
+
+	//The steps of advance, split so callers can time them.
+	//nextTick returns true when a new pulse starts. nextPulse returns true when the sequence wrapped and should evolve.
+	bool nextTick();
+	bool nextPulse(int maxBlock, bool evolveOn);
+	void buildTimeline(const NoteBlockPattern & pattern);
+	bool evaluateTick(NoteBlockOutput & out);
+	int gateSamples(int noteLength);
+
+	//Call once per sample after advancing. Returns true on the sample a timed gate ends.
+	bool gateEnd(){
+		if(gateSamplesLeft < 0) return false;
+		if(gateSamplesLeft-- > 0) return false;
+		gateSamplesLeft = -1;
+		return true;
+	}
+
+	int ticksPerPulse() const{
+		return ppqn / PULSES_PER_BLOCK;
+	}
+
+	//UI thread. Returns false while the last staged groove hasn't been taken yet, try again later.
+	bool stageGroove(const GrooveMap & map){
+		if(grooveStaged.load(std::memory_order_acquire)) return false;
+		stagedGroove = map;
+		grooveStaged.store(true, std::memory_order_release);
+		return true;
+	}
+
+	//Only while tick can't run, like on load or reset. Plays map from the next pulse and drops any staged groove.
+	void setGroove(const GrooveMap & map){
+		groove = map;
+		grooveStaged.store(false, std::memory_order_release);
+	}
+
+	//Any thread. Ignores resolutions not in PPQN_OPTIONS.
+	void setPpqn(int _ppqn){
+		if(isValidPpqn(_ppqn)) requestedPpqn = _ppqn;
+	}
+
+	//UI thread. The genetic worker is started the first time it's asked for and then waits idle until the sequencer
+	//is destroyed, so the audio thread never starts or joins it. The audio thread switches mode on the next loop.
+	void setEvolutionMode(EvolutionMode mode, uint64_t seed);
+
+	//Any thread, the mode last asked for
+	EvolutionMode getEvolutionMode() const{
+		return static_cast<EvolutionMode>(requestedEvolutionMode.load(std::memory_order_relaxed));
+	}
+
+	//Called when the sequence loops with evolution on
+	void evolve(const NoteBlockPattern & pattern, int maxBlock);
+	void publishMappingView();
+
+	bool isRunning(){
+		return clock.isRunning();
+	}
+
+	//Rescales the sample counted clock state so the pulse grid keeps its tempo and phase across a sample rate change
+	void setSampleRate(float sampleRate);
+
+	//Any thread. Moves the playhead by whole blocks so it stays on the same note after the blocks are shifted.
+	void shift(int deltaBlocks){
+		pendingShift += deltaBlocks;
+	}
+
+	//Returns a description of the first broken invariant, or NULL when the state is valid for maxBlock
+	const char* checkInvariants(int maxBlock) const;
+};
@@ -0,0 +1,208 @@
+#include "stepSequencer.hpp"
+#include <algorithm>
+
+void EvolvingStepSequencer::initalize(){
+	currentStep = -1;
+	currentBeat = -1;
+	currentEvolvedStep = -1;
+	currentDur = 0;
+
+	muted = false;
+	ratcheting = false;
+
+	cyclesToEvolve = 0;
+	evolutionCount = 0;
+	evolvingUp = true;
+	evolveDur = false;
+	for(int ni = 0; ni < STEP_COUNT; ni++){
+		evolutionMapping[ni] = -1;
+		evolutionRatcheting[ni] = 0;
+	}
+
+	stepDue = false;
+	maxStepReached = 0;
+}
+
+bool EvolvingStepSequencer::tick(float clockVoltage, float resetVoltage, float sampleTime){
+	bool clockEdge = schmittTrigger(clockHigh, clockVoltage);
+
+	//Reset Logic, before the clock so a reset arriving with a clock edge starts on the first step
+	bool replayClock;
+	if(reset.process(resetVoltage, clockEdge, sampleTime, replayClock)) initalize();
+
+	return clockEdge || replayClock;
+}
+
+bool EvolvingStepSequencer::nextBeat(const StepPattern & pattern){
+	bool resetCycle = false;
+	stepDue = false;
+
+	currentBeat++;
+	if(!pattern.lengthInSteps){
+		if(currentBeat >= pattern.length) resetCycle = true;
+	}
+
+	if(currentDur > 1){
+		currentDur--;
+	}else{
+		currentStep++;
+		stepDue = true;
+		if(pattern.lengthInSteps){
+			if(currentStep >= pattern.length/4) resetCycle = true;
+		}
+	}
+
+	if(resetCycle){
+		maxStepReached = currentStep;
+		currentStep = 0;
+		currentBeat = 0;
+	}
+	return resetCycle;
+}
+
+void EvolvingStepSequencer::evolve(const StepPattern & pattern){
+	evolveDur = rng.uniform() < pattern.durationEvolutionChance;
+
+	if(cyclesToEvolve > 1){
+		cyclesToEvolve --;
+		return;
+	}
+
+	cyclesToEvolve = pattern.cyclesPerEvolution;
+	int maxEvolution = pattern.evolutionLength;
+	if(evolutionCount >= maxEvolution){
+		evolvingUp = false;
+	}else if(evolutionCount <= 0){
+		evolvingUp = true;
+	}
+
+	if(evolvingUp && evolutionCount < maxEvolution){
+		evolutionCount++;
+		int indexes [STEP_COUNT];
+		int indexCount = 0;
+		for(int ni = 0; ni < maxStepReached && ni < STEP_COUNT; ni++){
+			if(evolutionMapping[ni] == -1) indexes[indexCount++] = ni;
+		}
+		if(indexCount > 0){
+			int index = indexes[rng.rndInt(indexCount)];
+			//A length in beats can play more steps than there are, they only remap onto real ones
+			int maxRnd = pattern.fullLengthEvolution ? STEP_COUNT : std::min(maxStepReached, STEP_COUNT);
+			evolutionMapping[index] = rng.rndInt(maxRnd);
+			evolutionRatcheting[index] = rng.uniform();
+		}
+	}else if(evolutionCount > 0){
+		if(pattern.instantDeevolution){
+			cyclesToEvolve = 0;
+			evolutionCount = 0;
+			evolvingUp = true;
+			evolveDur = false;
+			for(int ni = 0; ni < STEP_COUNT; ni++){
+				evolutionMapping[ni] = -1;
+				evolutionRatcheting[ni] = 0;
+			}
+		}else{
+			//Slow De-evolve
+			evolutionCount--;
+			if(evolutionCount <= maxStepReached){
+				int indexes [STEP_COUNT];
+				int indexCount = 0;
+				for(int ni = 0; ni < maxStepReached && ni < STEP_COUNT; ni++){
+					if(evolutionMapping[ni] != -1) indexes[indexCount++] = ni;
+				}
+				if(indexCount > 0){
+					int index = indexes[rng.rndInt(indexCount)];
+					evolutionMapping[index] = -1;
+				}
+			}
+		}
+	}
+}
+
+void EvolvingStepSequencer::startStep(const StepPattern & pattern){
+	if(!stepDue) return;
+
+	//A length in beats can run past the last step, the steps repeat from the first
+	int step = currentStep % STEP_COUNT;
+	currentEvolvedStep = evolutionMapping[step];
+	if(currentEvolvedStep == -1){
+		currentEvolvedStep = step;
+		ratcheting = false;
+	}else{
+		ratcheting = evolutionRatcheting[step] < pattern.ratchetChance;
+	}
+
+	currentDur = stepDuration(pattern.duration[evolveDur ? currentEvolvedStep : step], muted);
+}
+
+void RetrogradeStepSequencer::initalize(){
+	currentStep = -1;
+	currentStepRetrograde = -1;
+	currentBeat = -1;
+	currentDur = 0;
+	muted = false;
+
+	resetDue = false;
+	clockDue = false;
+}
+
+bool RetrogradeStepSequencer::tick(float clockVoltage, float resetVoltage, float retrogradeVoltage, float inversionVoltage, float sampleTime){
+	bool clockEdge = schmittTrigger(clockHigh, clockVoltage);
+
+	//Reset Logic, before the clock so a reset arriving with a clock edge starts on the first step
+	bool replayClock;
+	if(reset.process(resetVoltage, clockEdge, sampleTime, replayClock)){
+		initalize();
+		resetDue = true;
+	}
+	clockDue = clockEdge || replayClock;
+
+	schmittTrigger(retrogradeHigh, retrogradeVoltage);
+	schmittTrigger(inversionHigh, inversionVoltage);
+
+	return resetDue || clockDue;
+}
+
+void RetrogradeStepSequencer::advance(const StepPattern & pattern){
+	if(resetDue){
+		currentStepRetrograde = countSteps(pattern) - 1;
+		resetDue = false;
+	}
+	if(!clockDue) return;
+	clockDue = false;
+
+	bool resetCycle = false;
+	bool doNextStep = false;
+
+	currentBeat++;
+	if(currentBeat >= pattern.length) resetCycle = true;
+
+	if(currentDur > 1){
+		currentDur--;
+	}else{
+		doNextStep = true;
+		currentStep++;
+		currentStepRetrograde--;
+	}
+
+	if(resetCycle){
+		currentStep = 0;
+		currentStepRetrograde = countSteps(pattern) - 1;
+		currentBeat = 0;
+	}
+
+	if(doNextStep){
+		//A length in beats can run past the last step, the durations repeat from the first
+		currentDur = stepDuration(pattern.duration[currentStep % STEP_COUNT], muted);
+	}
+}
+
+int RetrogradeStepSequencer::countSteps(const StepPattern & pattern){
+	int maxBeats = pattern.length;
+	int step = 0;
+	bool rest;
+	while(maxBeats > 0){
+		maxBeats -= stepDuration(pattern.duration[step % STEP_COUNT], rest);
+		step++;
+	}
+	return step;
+}
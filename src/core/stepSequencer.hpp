@@ -0,0 +1,140 @@
+#pragma once
+
+#include "clock.hpp"
+#include "random.hpp"
+
+#define STEP_COUNT 16
+
+//Sequencer1 and Sequencer2's step sequencing without any Rack types.
+//The modules read their params into a StepPattern when tick reports a clock and copy the outputs back.
+
+//A duration of zero or less is a rest of 1 - duration beats
+inline int stepDuration(int duration, bool & rest){
+	rest = duration <= 0;
+	return rest ? -duration + 1 : duration;
+}
+
+struct StepPattern{
+	int duration [STEP_COUNT];
+	int length = 8; //In beats, or in quarters of a step when lengthInSteps
+	bool lengthInSteps = false;
+
+	//Evolution, only used by EvolvingStepSequencer
+	int evolutionLength = 0; //Steps remapped at the peak of an evolution
+	int cyclesPerEvolution = 1;
+	float durationEvolutionChance = 0;
+	bool fullLengthEvolution = false; //Remap to any step rather than only the ones played
+	bool instantDeevolution = false; //Rather than ping-pong back one step at a time
+	float ratchetChance = 0;
+
+	StepPattern(){
+		for(int ni = 0; ni < STEP_COUNT; ni++) duration[ni] = 2;
+	}
+};
+
+//Sequencer1, a step sequencer whose steps are remapped one at a time as it loops and back again.
+//A remapped step ratchets, gating on each clock, when its roll is under the ratchet chance.
+struct EvolvingStepSequencer{
+	ResetScheduler reset;
+	bool clockHigh;
+
+	int currentStep;
+	int currentBeat;
+	int currentEvolvedStep;
+	int currentDur;
+	bool muted;
+	bool ratcheting;
+	int cyclesToEvolve;
+	int evolutionCount;
+	bool evolvingUp;
+	int evolutionMapping [STEP_COUNT]; //-1 for steps that aren't remapped
+	float evolutionRatcheting [STEP_COUNT];
+	bool evolveDur;
+	CoreRandom rng;
+
+	//Set by nextBeat
+	bool stepDue;
+	int maxStepReached;
+
+	EvolvingStepSequencer(){
+		clockHigh = false;
+		initalize();
+	}
+
+	//Clears the playback and evolution state, the reset settings are kept
+	void initalize();
+
+	//Watches the clock and reset inputs. Returns true when a clock step is due, advance should then be called.
+	bool tick(float clockVoltage, float resetVoltage, float sampleTime);
+
+	void advance(const StepPattern & pattern){
+		if(nextBeat(pattern)) evolve(pattern);
+		startStep(pattern);
+	}
+
+	//The steps of advance, split so callers can time them.
+	//nextBeat returns true when the sequence wrapped and should evolve, startStep picks the next step when one is due.
+	bool nextBeat(const StepPattern & pattern);
+	void evolve(const StepPattern & pattern);
+	void startStep(const StepPattern & pattern);
+
+	//The step whose CV plays, -1 while muted or before the first step when the CV should hold
+	int outputStep() const{
+		return muted ? -1 : currentEvolvedStep;
+	}
+
+	bool gateHigh() const{
+		return !muted && (clockHigh || (!ratcheting && currentDur > 1));
+	}
+};
+
+//Sequencer2, a step sequencer that can play its steps backwards and inverted around the first step
+struct RetrogradeStepSequencer{
+	ResetScheduler reset;
+	bool clockHigh;
+	bool retrogradeHigh;
+	bool inversionHigh;
+
+	int currentStep;
+	int currentStepRetrograde;
+	int currentBeat;
+	int currentDur;
+	bool muted;
+
+	//Set by tick, handled by advance
+	bool resetDue;
+	bool clockDue;
+
+	RetrogradeStepSequencer(){
+		clockHigh = false;
+		retrogradeHigh = false;
+		inversionHigh = false;
+		initalize();
+	}
+
+	void initalize();
+
+	//Watches the clock, reset, retrograde and inversion inputs.
+	//Returns true when a reset or clock step is due, advance should then be called.
+	bool tick(float clockVoltage, float resetVoltage, float retrogradeVoltage, float inversionVoltage, float sampleTime);
+
+	void advance(const StepPattern & pattern);
+
+	//Steps played before the sequence loops
+	static int countSteps(const StepPattern & pattern);
+
+	//The step whose CV plays, -1 for 0V once a length in beats runs past the last step. The CV holds while muted.
+	int outputStep() const{
+		int step = retrogradeHigh ? currentStepRetrograde : currentStep;
+		return step >= 0 && step < STEP_COUNT ? step : -1;
+	}
+
+	//Applies the inversion input to a step's value, root is the first step's
+	float transform(float value, float root) const{
+		return inversionHigh ? root - (value - root) : value;
+	}
+
+	bool gateHigh() const{
+		return !muted && (clockHigh || currentDur > 1);
+	}
+};
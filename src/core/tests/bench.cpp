@@ -0,0 +1,85 @@
+//Times the sequencing core without Rack. `make bench` runs it.
+//advance is the per sample cost on the audio thread, for each evolution mode and a few resolutions. The genetic
+//rows include the worker thread running alongside, as it does in Rack.
+//runGeneration is the genetic worker's throughput, in candidates scored per budgeted loop.
+
+#include "../sequencer.hpp"
+#include <chrono>
+#include <cstdio>
+
+using BenchClock = std::chrono::steady_clock;
+
+static void benchPattern(NoteBlockPattern & pattern, int blockCount){
+	CoreRandom rng;
+	rng.seed(7, 11);
+	pattern.blockCount = blockCount;
+	for(int bi = 0; bi < blockCount; bi++){
+		float params [NOTE_BLOCK_PARAM_COUNT];
+		params[0] = 1 + rng.rndInt(7);
+		for(int ni = 0; ni < 4; ni++){
+			params[1 + ni * 2] = rng.uniform() * 4 - 2;
+			params[2 + ni * 2] = rng.rndInt(5) == 0 ? NE_TIE : NE_NONE;
+		}
+		pattern.blocks[bi] = readNoteBlock(params);
+	}
+}
+
+//A 120 bpm clock at 48kHz through tick and advance, like Sequencer3's process
+static void benchAdvance(const char* name, EvolutionMode mode, int ppqn, int blockCount){
+	const float sampleRate = 48000;
+	const int clockPeriod = 24000;
+	const long samples = 48000 * 60;
+
+	NoteBlockPattern pattern;
+	benchPattern(pattern, blockCount);
+	NoteBlockSequencer seq;
+	seq.rng.seed(1, 2);
+	seq.setSampleRate(sampleRate);
+	seq.setPpqn(ppqn);
+	seq.setEvolutionMode(mode, 3);
+	seq.evolution.setBlockSpace(blockCount);
+
+	volatile float sink = 0; //Keeps the outputs from being optimized away
+	BenchClock::time_point start = BenchClock::now();
+	for(long i = 0; i < samples; i++){
+		float clockVoltage = i % clockPeriod < 100 ? 10.f : 0.f;
+		if(seq.tick(clockVoltage, 0, 1 / sampleRate)){
+			NoteBlockOutput out;
+			if(seq.advance(pattern, blockCount, true, out)) sink += out.cv;
+		}
+		seq.gateEnd();
+	}
+	double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+	printf("advance %-8s ppqn %3d blocks %2d  %7.2f ns/sample  %6.0fx realtime\n", name, ppqn, blockCount,
+		seconds * 1e9 / samples, samples / sampleRate / seconds);
+}
+
+static void benchGeneration(int blockCount, float budgetMs){
+	NoteBlockPattern pattern;
+	benchPattern(pattern, blockCount);
+	GeneticEvolver evolver;
+	evolver.rng.seed(5, 6);
+	GeneticSettings settings;
+	settings.budgetMs = budgetMs;
+
+	const int loops = 100;
+	long candidates = 0;
+	BenchClock::time_point start = BenchClock::now();
+	for(int li = 0; li < loops; li++){
+		candidates += evolver.runGeneration(pattern, blockCount, settings, blockCount);
+	}
+	double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+	printf("runGeneration blocks %2d budget %.1fms  %8.0f candidates/loop  %7.2f us/candidate\n", blockCount, budgetMs,
+		candidates / (double) loops, seconds * 1e6 / (candidates > 0 ? candidates : 1));
+}
+
+int main(){
+	benchAdvance("random", EM_RANDOM, PULSES_PER_BLOCK, CORE_MAX_BLOCKS);
+	benchAdvance("random", EM_RANDOM, 96, CORE_MAX_BLOCKS);
+	benchAdvance("random", EM_RANDOM, 480, CORE_MAX_BLOCKS);
+	benchAdvance("genetic", EM_GENETIC, PULSES_PER_BLOCK, CORE_MAX_BLOCKS);
+	benchAdvance("genetic", EM_GENETIC, PULSES_PER_BLOCK, CHAIN_MAX_BLOCKS);
+	benchGeneration(CORE_MAX_BLOCKS, 2);
+	benchGeneration(CHAIN_MAX_BLOCKS, 2);
+	return 0;
+}
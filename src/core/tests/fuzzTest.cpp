@@ -0,0 +1,121 @@
+//Drives NoteBlockSequencer with random patterns, clocks, resets and settings changes, including out-of-range
+//and non-finite param values, and checks its invariants after every sample. `make fuzz` runs it.
+
+#include "../sequencer.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+//Mostly sensible values with the odd one far out of range, infinite or NaN, like a corrupt patch
+static float paramValue(CoreRandom & rng, float low, float high){
+	float r = rng.uniform();
+	if(r < 0.01f) return std::numeric_limits<float>::quiet_NaN();
+	if(r < 0.02f) return rng.uniform() < 0.5f ? INFINITY : -INFINITY;
+	if(r < 0.05f) return (rng.uniform() * 2 - 1) * 1e6f;
+	return low + rng.uniform() * (high - low);
+}
+
+static void randomPattern(CoreRandom & rng, NoteBlockPattern & pattern){
+	pattern.blockCount = 1 + rng.rndInt(CHAIN_MAX_BLOCKS);
+	for(int bi = 0; bi < pattern.blockCount; bi++){
+		float params [NOTE_BLOCK_PARAM_COUNT];
+		params[0] = paramValue(rng, 1, 7);
+		for(int ni = 0; ni < 4; ni++){
+			params[1 + ni * 2] = paramValue(rng, -2, 2);
+			params[2 + ni * 2] = paramValue(rng, 0, 2);
+		}
+		pattern.blocks[bi] = readNoteBlock(params);
+		for(int ni = 0; ni < 4; ni++){
+			pattern.blocks[bi].timing[ni] = paramValue(rng, -NOTE_TIMING_MAX, NOTE_TIMING_MAX);
+		}
+	}
+}
+
+static bool fuzz(uint64_t seed, long samples){
+	CoreRandom rng;
+	rng.seed(seed, ~seed);
+
+	NoteBlockSequencer seq;
+	seq.rng.seed(seed, seed + 1);
+	float sampleRate = 48000;
+	seq.setSampleRate(sampleRate);
+	if(rng.uniform() < 0.25f) seq.setEvolutionMode(EM_GENETIC, seed);
+
+	NoteBlockPattern pattern;
+	randomPattern(rng, pattern);
+	int length = 1 + rng.rndInt(CHAIN_MAX_BLOCKS);
+	int checkLength = length; //The length the current pulse was played with
+	int blockSpace = CORE_MAX_BLOCKS;
+	bool evolveOn = rng.uniform() < 0.5f;
+	int clockPeriod = 100 + rng.rndInt(4000);
+	int resetAt = -1;
+
+	for(long i = 0; i < samples; i++){
+		//Settings change rarely, like a hand on the panel
+		if(rng.uniform() < 0.0005f){
+			switch(rng.rndInt(9)){
+				case 0: randomPattern(rng, pattern); break;
+				case 1: length = 1 + rng.rndInt(CHAIN_MAX_BLOCKS); break;
+				case 2: evolveOn = !evolveOn; break;
+				case 3: clockPeriod = 20 + rng.rndInt(8000); break;
+				case 4: seq.setPpqn(PPQN_OPTIONS[rng.rndInt(PPQN_OPTION_COUNT)]); break;
+				case 5: seq.shift(rng.rndInt(9) - 4); break;
+				case 6: blockSpace = 1 + rng.rndInt(CHAIN_MAX_BLOCKS); break;
+				case 7:
+					sampleRate = rng.uniform() < 0.5f ? 44100 : 96000;
+					seq.setSampleRate(sampleRate);
+					break;
+				case 8:{
+					float offsets [GROOVE_STEPS];
+					for(int si = 0; si < GROOVE_STEPS; si++) offsets[si] = paramValue(rng, -NOTE_TIMING_MAX, NOTE_TIMING_MAX);
+					GrooveMap map;
+					grooveTemplateOffsets(GROOVE_CUSTOM, offsets, offsets);
+					buildGrooveMap(offsets, map);
+					seq.stageGroove(map);
+					break;
+				}
+			}
+		}
+		if(rng.uniform() < 0.0002f) resetAt = i;
+		seq.reset.mode = (i / 50000) % 2 == 0 ? RESET_IMMEDIATE : RESET_NEXT_CLOCK;
+		seq.reset.window = (i / 70000) % 2 == 0 ? 0 : 0.005f;
+
+		float clockVoltage = i % clockPeriod < clockPeriod / 2 ? 10.f : 0.f;
+		float resetVoltage = resetAt >= 0 && i - resetAt < 10 ? 10.f : 0.f;
+
+		if(seq.tick(clockVoltage, resetVoltage, 1.f / sampleRate)){
+			//advance split up so the invariants are checked against the length of the pulse being played
+			if(seq.nextTick()){
+				//Sequencer3 sizes the block space as it reads the chain at the start of a pulse
+				seq.evolution.setBlockSpace(blockSpace);
+				if(seq.nextPulse(length, evolveOn)) seq.evolve(pattern, length);
+				seq.buildTimeline(pattern);
+				checkLength = length;
+			}
+			NoteBlockOutput out;
+			if(seq.evaluateTick(out) && (out.updateCV && !std::isfinite(out.cv))){
+				printf("seed %llu sample %ld: cv not finite\n", (unsigned long long) seed, i);
+				return false;
+			}
+		}
+		seq.gateEnd();
+
+		const char* error = seq.checkInvariants(checkLength);
+		if(error){
+			printf("seed %llu sample %ld: %s\n", (unsigned long long) seed, i, error);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv){
+	int runs = argc > 1 ? atoi(argv[1]) : 200;
+	uint64_t firstSeed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+	for(int ri = 0; ri < runs; ri++){
+		if(!fuzz(firstSeed + ri, 200000)) return 1;
+	}
+	printf("ok   %d runs\n", runs);
+	return 0;
+}
@@ -0,0 +1,208 @@
+//Renders the sequencer cores for a set of representative patterns and compares the output events to the goldens
+//checked in next to it. `make test` runs it, `make golden` rewrites the goldens after an intended change.
+
+#include "../render.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+struct RenderCase{
+	const char* name;
+	void (*setup)(NoteBlockPattern & pattern, RenderSettings & settings);
+};
+
+//Sequencer1 and Sequencer2
+struct StepRenderCase{
+	const char* name;
+	void (*setup)(StepPattern & pattern, float* cv, RenderSettings & settings);
+	void (*render)(const StepPattern & pattern, const float* cv, const RenderSettings & settings, EventRecorder & recorder);
+};
+
+//Each subdivision in turn, with the notes walking up
+static void subdivisionPattern(NoteBlockPattern & pattern){
+	pattern.blockCount = CORE_MAX_BLOCKS;
+	for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++){
+		NoteBlock & block = pattern.blocks[bi];
+		block.subdivision = 1 + bi % 7;
+		for(int ni = 0; ni < 4; ni++){
+			block.cv[ni] = (bi * 4 + ni) / 12.f - 2;
+			block.extra[ni] = NE_NONE;
+			block.timing[ni] = 0;
+		}
+	}
+}
+
+static void subdivisions(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+}
+
+static void mutesAndTies(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+	for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++){
+		for(int ni = 0; ni < 4; ni++){
+			int e = (bi + ni) % 5;
+			pattern.blocks[bi].extra[ni] = e == 1 ? NE_MUTE : (e == 3 ? NE_TIE : NE_NONE);
+		}
+	}
+}
+
+static void swing(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+	swingOffsets(66, settings.groove);
+}
+
+static void microtiming(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+	for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++){
+		for(int ni = 0; ni < 4; ni++){
+			pattern.blocks[bi].timing[ni] = ((bi + ni) % 3 - 1) * 1.5f;
+		}
+	}
+}
+
+static void fineResolution(NoteBlockPattern & pattern, RenderSettings & settings){
+	microtiming(pattern, settings);
+	swingOffsets(58, settings.groove);
+	settings.ppqn = PULSES_PER_BLOCK * 4;
+}
+
+static void gatePercent(NoteBlockPattern & pattern, RenderSettings & settings){
+	mutesAndTies(pattern, settings);
+	settings.gate.mode = GATE_PERCENT;
+	settings.gate.percent = 80;
+}
+
+static void gateMs(NoteBlockPattern & pattern, RenderSettings & settings){
+	mutesAndTies(pattern, settings);
+	settings.gate.mode = GATE_MS;
+	settings.gate.ms = 5;
+}
+
+static void reset(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+	settings.resetAt = settings.clockPeriod * 5 + 1000;
+}
+
+//A reset one sample after an edge. Without a window the pulse grid restarts on the reset, not on the edge.
+static void lateReset(NoteBlockPattern & pattern, RenderSettings & settings){
+	subdivisionPattern(pattern);
+	settings.resetAt = settings.clockPeriod * 5 + 1;
+}
+
+//The same reset inside the window replays the edge it missed, keeping the grid on the clock
+static void lateResetWindow(NoteBlockPattern & pattern, RenderSettings & settings){
+	lateReset(pattern, settings);
+	settings.resetWindow = 0.005f;
+}
+
+static void evolution(NoteBlockPattern & pattern, RenderSettings & settings){
+	mutesAndTies(pattern, settings);
+	settings.seqLength = CORE_MAX_BLOCKS;
+	settings.samples = (long) settings.clockPeriod * CORE_MAX_BLOCKS * 6;
+	settings.evolveOn = true;
+	settings.seed = 3;
+}
+
+static const RenderCase CASES [] = {
+	{"subdivisions", subdivisions},
+	{"mutesAndTies", mutesAndTies},
+	{"swing", swing},
+	{"microtiming", microtiming},
+	{"fineResolution", fineResolution},
+	{"gatePercent", gatePercent},
+	{"gateMs", gateMs},
+	{"reset", reset},
+	{"lateReset", lateReset},
+	{"lateResetWindow", lateResetWindow},
+	{"evolution", evolution},
+};
+
+//Mixed durations with a rest, the notes walking up in fifths
+static void stepPattern(StepPattern & pattern, float* cv){
+	static const int DURATIONS [STEP_COUNT] = {1, 2, 1, 3, -1, 1, 2, 4, 1, 1, -2, 2, 1, 3, 1, 2};
+	for(int ni = 0; ni < STEP_COUNT; ni++){
+		pattern.duration[ni] = DURATIONS[ni];
+		cv[ni] = (ni * 7 % 12) / 12.f;
+	}
+}
+
+//Remaps a step each loop up to 6 and back, most of them ratcheting
+static void ratchet(StepPattern & pattern, float* cv, RenderSettings & settings){
+	stepPattern(pattern, cv);
+	pattern.length = 12;
+	pattern.evolutionLength = 6;
+	pattern.durationEvolutionChance = 0.3f;
+	pattern.ratchetChance = 0.7f;
+	settings.samples = (long) settings.clockPeriod * pattern.length * 14;
+	settings.seed = 5;
+}
+
+//Forwards, then retrograde, then retrograde inversion
+static void retrograde(StepPattern & pattern, float* cv, RenderSettings & settings){
+	stepPattern(pattern, cv);
+	pattern.length = 12;
+	settings.samples = (long) settings.clockPeriod * pattern.length * 3;
+	settings.retrogradeFrom = (long) settings.clockPeriod * pattern.length;
+	settings.inversionFrom = (long) settings.clockPeriod * pattern.length * 2;
+}
+
+static const StepRenderCase STEP_CASES [] = {
+	{"ratchet", ratchet, renderEvolvingStepSequencer},
+	{"retrograde", retrograde, renderRetrogradeStepSequencer},
+};
+
+//Returns false when the events don't match the golden, or rewrites it when updating
+static bool checkGolden(const char* goldenDir, const char* name, const std::vector<OutputEvent> & events, bool update){
+	std::string path = std::string(goldenDir) + "/" + name + ".txt";
+	if(update){
+		std::ofstream(path) << formatEvents(events);
+		printf("wrote %s\n", path.c_str());
+		return true;
+	}
+
+	std::ifstream file(path);
+	std::stringstream text;
+	text << file.rdbuf();
+	std::vector<OutputEvent> golden;
+	if(!file || !parseEvents(text.str(), golden)){
+		printf("FAIL %s: can't read %s\n", name, path.c_str());
+		return false;
+	}
+	int diff = compareEvents(events, golden);
+	if(diff >= 0){
+		long sample = diff < (int) events.size() ? events[diff].sample : golden[diff].sample;
+		printf("FAIL %s: event %d differs near sample %ld\n", name, diff, sample);
+		return false;
+	}
+	printf("ok   %s\n", name);
+	return true;
+}
+
+int main(int argc, char** argv){
+	if(argc < 2){
+		fprintf(stderr, "usage: %s goldenDir [--update]\n", argv[0]);
+		return 2;
+	}
+	bool update = argc > 2 && strcmp(argv[2], "--update") == 0;
+
+	int failed = 0;
+	for(const RenderCase & c : CASES){
+		NoteBlockPattern pattern;
+		RenderSettings settings;
+		c.setup(pattern, settings);
+		EventRecorder recorder;
+		renderNoteBlockSequencer(pattern, settings, recorder);
+		if(!checkGolden(argv[1], c.name, recorder.events, update)) failed++;
+	}
+	for(const StepRenderCase & c : STEP_CASES){
+		StepPattern pattern;
+		float cv [STEP_COUNT];
+		RenderSettings settings;
+		c.setup(pattern, cv, settings);
+		EventRecorder recorder;
+		c.render(pattern, cv, settings, recorder);
+		if(!checkGolden(argv[1], c.name, recorder.events, update)) failed++;
+	}
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+#include "timeline.hpp"
+#include <cmath>
+
+bool isValidPpqn(int ppqn){
+	for(int i = 0; i < PPQN_OPTION_COUNT; i++){
+		if(PPQN_OPTIONS[i] == ppqn) return true;
+	}
+	return false;
+}
+
+void BlockTimeline::build(const NoteBlockPattern & pattern, int block, int ticksPerPulse, const GrooveMap & groove){
+	eventCount = 0;
+	cursor = 0;
+	if(block < 0 || block >= CHAIN_MAX_BLOCKS) return;
+
+	const NoteBlock & noteBlock = pattern.blocks[block];
+	int blockStart = block * PULSES_PER_BLOCK;
+	int lastTick = PULSES_PER_BLOCK * ticksPerPulse - 1;
+	for(int pi = 0; pi < PULSES_PER_BLOCK; pi++){
+		TimelineEvent e;
+		getOutputValues(pattern, blockStart + pi, e.cv, e.updateCV, e.gateHigh);
+		if(eventCount > 0){
+			//Only keep pulses where the outputs change
+			const TimelineEvent & prev = events[eventCount - 1];
+			if(prev.gateHigh == e.gateHigh && prev.updateCV == e.updateCV && (!e.updateCV || prev.cv == e.cv)) continue;
+		}
+
+		int noteIndex = getNoteIndexForPulse(noteBlock.subdivision, pi);
+		e.noteStart = pi == 0 || noteIndex != getNoteIndexForPulse(noteBlock.subdivision, pi - 1);
+		e.noteLength = 1;
+		while(pi + e.noteLength < PULSES_PER_BLOCK && getNoteIndexForPulse(noteBlock.subdivision, pi + e.noteLength) == noteIndex) e.noteLength++;
+		e.gateHeld = false;
+		if(e.noteStart && e.gateHigh){
+			//The grid only keeps the gate high on the note's last pulse when it ties into the next
+			float cv;
+			bool updateCV;
+			getOutputValues(pattern, blockStart + pi + e.noteLength - 1, cv, updateCV, e.gateHeld);
+		}
+
+		//Every change belongs to the note playing on that pulse, so a note's gate moves with it
+		float timing = 0;
+		if(block < pattern.blockCount) timing = noteBlock.timing[getNoteIndexForPulse(noteBlock.subdivision, pi)];
+		if(!(timing >= -NOTE_TIMING_MAX)) timing = std::isnan(timing) ? 0 : -NOTE_TIMING_MAX;
+		if(timing > NOTE_TIMING_MAX) timing = NOTE_TIMING_MAX;
+		//Groove moves the whole note by its start's offset, so swing never stretches or clips a gate
+		int notePulse = pi;
+		while(notePulse > 0 && getNoteIndexForPulse(noteBlock.subdivision, notePulse - 1) == noteIndex) notePulse--;
+		e.tick = pi * ticksPerPulse + (int) std::round((groove.offset[notePulse] + timing) * ticksPerPulse);
+
+		//Stay inside the block and never pass the previous change, so a nudged note can't swap with its neighbour
+		if(e.tick < 0) e.tick = 0;
+		if(e.tick > lastTick) e.tick = lastTick;
+		if(eventCount > 0 && e.tick < events[eventCount - 1].tick) e.tick = events[eventCount - 1].tick;
+		events[eventCount++] = e;
+	}
+}
+
+void BlockTimeline::seek(int tick, bool catchUp){
+	cursor = 0;
+	while(cursor < eventCount && events[cursor].tick < tick) cursor++;
+	if(catchUp && cursor > 0 && (cursor >= eventCount || events[cursor].tick > tick)) cursor--;
+}
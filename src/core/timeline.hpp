@@ -0,0 +1,43 @@
+#pragma once
+
+#include "noteBlock.hpp"
+#include "groove.hpp"
+#include <cstddef>
+
+//Pulse timeline resolutions Sequencer3 can run at. The note grid stays at PULSES_PER_BLOCK, finer
+//resolutions split each of its pulses into ticks so notes can be nudged off the grid.
+#define PPQN_OPTION_COUNT 4
+static const int PPQN_OPTIONS [PPQN_OPTION_COUNT] = {24, 48, 96, 480};
+
+bool isValidPpqn(int ppqn);
+
+//An output change ticks after the start of the block
+struct TimelineEvent{
+	int tick;
+	float cv;
+	bool updateCV;
+	bool gateHigh;
+	bool noteStart; //False for a gate ending part way through its note
+	int noteLength; //Pulses until the next note, for timed gates
+	bool gateHeld; //Tied into the next note, so the gate stays high for the whole note
+};
+
+//The output changes of one block with each note moved by the groove and its microtiming. Built once per pulse,
+//so every tick only compares against the next event however fine the resolution is.
+struct BlockTimeline{
+	TimelineEvent events [PULSES_PER_BLOCK];
+	int eventCount = 0;
+	int cursor = 0;
+
+	void build(const NoteBlockPattern & pattern, int block, int ticksPerPulse, const GrooveMap & groove);
+
+	//Points the cursor at the first event from tick on. With catchUp the last event before tick is replayed
+	//as well, for when the playhead jumped and the outputs are not in the state that event left them.
+	void seek(int tick, bool catchUp);
+
+	//Returns the next event due by tick, or NULL when none are left
+	const TimelineEvent* next(int tick){
+		if(cursor >= eventCount || events[cursor].tick > tick) return NULL;
+		return &events[cursor++];
+	}
+};
@@ -0,0 +1,182 @@
+#include "coreAdapter.hpp"
+#include "core/scales.hpp"
+
+void readNoteBlockPattern(Module* module, int baseParamIndex, int blockCount, NoteBlockPattern & pattern, int timingParamIndex){
+	float blockParams [NOTE_BLOCK_PARAM_COUNT];
+	pattern.blockCount = clamp(blockCount, 0, CORE_MAX_BLOCKS);
+	for(int bi = 0; bi < pattern.blockCount; bi++){
+		for(int i = 0; i < NOTE_BLOCK_PARAM_COUNT; i++){
+			blockParams[i] = module->params[baseParamIndex + bi * NOTE_BLOCK_PARAM_COUNT + i].getValue();
+		}
+		pattern.blocks[bi] = readNoteBlock(blockParams);
+		if(timingParamIndex < 0) continue;
+		for(int ni = 0; ni < 4; ni++){
+			pattern.blocks[bi].timing[ni] = module->params[timingParamIndex + bi * 4 + ni].getValue();
+		}
+	}
+}
+
+void readStepPattern(Module* module, int durationParamIndex, int lengthParamIndex, StepPattern & pattern){
+	for(int ni = 0; ni < STEP_COUNT; ni++){
+		pattern.duration[ni] = module->params[durationParamIndex + ni].getValue();
+	}
+	pattern.length = module->params[lengthParamIndex].getValue();
+}
+
+void writeNoteBlock(ParamBatch & batch, int blockIndex, const NoteBlock & block){
+	float blockParams [NOTE_BLOCK_PARAM_COUNT];
+	writeNoteBlock(block, blockParams);
+	for(int i = 0; i < NOTE_BLOCK_PARAM_COUNT; i++){
+		batch.setValue(blockIndex * NOTE_BLOCK_PARAM_COUNT + i, blockParams[i]);
+	}
+}
+
+json_t* json_markovModel(const MarkovModel & model){
+	json_t *jobj = json_object();
+	json_object_set_new(jobj, "intervalCounts", json_floatArray(&model.intervalCounts[0][0], MARKOV_INTERVALS * MARKOV_INTERVALS));
+	json_object_set_new(jobj, "subdivCounts", json_floatArray(&model.subdivCounts[0][0], MARKOV_SUBDIVS * MARKOV_SUBDIVS));
+	json_object_set_new(jobj, "noteCount", json_real(model.noteCount));
+	json_object_set_new(jobj, "muteCount", json_real(model.muteCount));
+	json_object_set_new(jobj, "tieChances", json_real(model.tieChances));
+	json_object_set_new(jobj, "tieCount", json_real(model.tieCount));
+	json_object_set_new(jobj, "patternsLearned", json_integer(model.patternsLearned));
+	return jobj;
+}
+
+void json_markovModel_value(json_t* jobj, MarkovModel & model){
+	model.clear();
+	if(!jobj) return;
+	json_floatArray_value(json_object_get(jobj, "intervalCounts"), &model.intervalCounts[0][0], MARKOV_INTERVALS * MARKOV_INTERVALS);
+	json_floatArray_value(json_object_get(jobj, "subdivCounts"), &model.subdivCounts[0][0], MARKOV_SUBDIVS * MARKOV_SUBDIVS);
+	model.noteCount = json_real_value(json_object_get(jobj, "noteCount"));
+	model.muteCount = json_real_value(json_object_get(jobj, "muteCount"));
+	model.tieChances = json_real_value(json_object_get(jobj, "tieChances"));
+	model.tieCount = json_real_value(json_object_get(jobj, "tieCount"));
+	model.patternsLearned = json_integer_value(json_object_get(jobj, "patternsLearned"));
+}
+
+json_t* json_geneticSettings(const GeneticSettings & settings){
+	json_t *jobj = json_object();
+	json_object_set_new(jobj, "scaleWeight", json_real(settings.scaleWeight));
+	json_object_set_new(jobj, "smoothWeight", json_real(settings.smoothWeight));
+	json_object_set_new(jobj, "densityWeight", json_real(settings.densityWeight));
+	json_object_set_new(jobj, "densityTarget", json_real(settings.densityTarget));
+	json_object_set_new(jobj, "scale", json_integer(settings.scale));
+	json_object_set_new(jobj, "root", json_integer(settings.root));
+	json_object_set_new(jobj, "budgetMs", json_real(settings.budgetMs));
+	return jobj;
+}
+
+void json_geneticSettings_value(json_t* jobj, GeneticSettings & settings){
+	if(!jobj) return;
+	settings.scaleWeight = json_number_value(json_object_get(jobj, "scaleWeight"));
+	settings.smoothWeight = json_number_value(json_object_get(jobj, "smoothWeight"));
+	settings.densityWeight = json_number_value(json_object_get(jobj, "densityWeight"));
+	settings.densityTarget = json_number_value(json_object_get(jobj, "densityTarget"));
+	settings.scale = clamp((int) json_integer_value(json_object_get(jobj, "scale")), 0, NUM_OF_SCALES - 1);
+	settings.root = clamp((int) json_integer_value(json_object_get(jobj, "root")), 0, 11);
+	settings.budgetMs = clamp((float) json_number_value(json_object_get(jobj, "budgetMs")), 0.1f, 50.f);
+}
+
+json_t* json_resetScheduler(const ResetScheduler & reset){
+	json_t *jobj = json_object();
+	json_object_set_new(jobj, "mode", json_integer(reset.mode));
+	json_object_set_new(jobj, "window", json_real(reset.window));
+	return jobj;
+}
+
+void json_resetScheduler_value(json_t* jobj, ResetScheduler & reset){
+	if(!jobj) return;
+	reset.mode = json_integer_value(json_object_get(jobj, "mode")) == RESET_NEXT_CLOCK ? RESET_NEXT_CLOCK : RESET_IMMEDIATE;
+	reset.window = clamp((float) json_number_value(json_object_get(jobj, "window")), 0.f, 0.1f);
+}
+
+json_t* json_gateSettings(const GateSettings & gate){
+	json_t *jobj = json_object();
+	json_object_set_new(jobj, "mode", json_integer(gate.mode));
+	json_object_set_new(jobj, "percent", json_real(gate.percent));
+	json_object_set_new(jobj, "ms", json_real(gate.ms));
+	return jobj;
+}
+
+void json_gateSettings_value(json_t* jobj, GateSettings & gate){
+	if(!jobj) return;
+	int mode = json_integer_value(json_object_get(jobj, "mode"));
+	gate.mode = (mode == GATE_PERCENT || mode == GATE_MS) ? static_cast<GateMode>(mode) : GATE_GRID;
+	gate.percent = clamp((float) json_number_value(json_object_get(jobj, "percent")), 1.f, 100.f);
+	gate.ms = clamp((float) json_number_value(json_object_get(jobj, "ms")), 0.1f, 1000.f);
+}
+
+int json_samples_value(json_t* jobj, const char* timeKey, const char* samplesKey, float sampleRate){
+	json_t* timeJ = json_object_get(jobj, timeKey);
+	if(timeJ) return (int) std::round(json_number_value(timeJ) * sampleRate);
+	return json_integer_value(json_object_get(jobj, samplesKey));
+}
+
+void addResetMenu(Menu* menu, ResetScheduler* reset){
+	menu->addChild(createSubmenuItem("Reset", reset->mode == RESET_NEXT_CLOCK ? "On Next Clock" : "Immediate",
+		[=](Menu* menu) {
+			menu->addChild(createMenuItem("Immediate", CHECKMARK(reset->mode == RESET_IMMEDIATE),
+				[=]() {
+					reset->mode = RESET_IMMEDIATE;
+				}
+			));
+			menu->addChild(createMenuItem("On Next Clock", CHECKMARK(reset->mode == RESET_NEXT_CLOCK),
+				[=]() {
+					reset->mode = RESET_NEXT_CLOCK;
+				}
+			));
+
+			static const float WINDOWS[] = {0.f, 0.001f, 0.002f, 0.005f, 0.01f};
+			menu->addChild(new MenuEntry); //Blank Row
+			menu->addChild(createMenuLabel("Late Reset Window"));
+			for(float window : WINDOWS){
+				menu->addChild(createMenuItem(window == 0 ? "Off" : string::f("%g ms", window * 1000), CHECKMARK(reset->window == window),
+					[=]() {
+						reset->window = window;
+					},
+					reset->mode != RESET_IMMEDIATE
+				));
+			}
+		}
+	));
+}
+
+void addGateMenu(Menu* menu, GateSettings* gate){
+	std::string rightText = "Grid";
+	if(gate->mode == GATE_PERCENT) rightText = string::f("%g%%", gate->percent);
+	if(gate->mode == GATE_MS) rightText = string::f("%g ms", gate->ms);
+	menu->addChild(createSubmenuItem("Gate Length", rightText,
+		[=](Menu* menu) {
+			menu->addChild(createMenuItem("Grid (Half Note)", CHECKMARK(gate->mode == GATE_GRID),
+				[=]() {
+					gate->mode = GATE_GRID;
+				}
+			));
+
+			static const float PERCENTS[] = {10.f, 25.f, 50.f, 75.f, 90.f, 100.f};
+			menu->addChild(new MenuEntry); //Blank Row
+			menu->addChild(createMenuLabel("Percent of Note"));
+			for(float percent : PERCENTS){
+				menu->addChild(createMenuItem(string::f("%g%%", percent), CHECKMARK(gate->mode == GATE_PERCENT && gate->percent == percent),
+					[=]() {
+						gate->percent = percent;
+						gate->mode = GATE_PERCENT;
+					}
+				));
+			}
+
+			static const float MS[] = {1.f, 2.f, 5.f, 10.f, 20.f, 50.f};
+			menu->addChild(new MenuEntry); //Blank Row
+			menu->addChild(createMenuLabel("Fixed"));
+			for(float ms : MS){
+				menu->addChild(createMenuItem(string::f("%g ms", ms), CHECKMARK(gate->mode == GATE_MS && gate->ms == ms),
+					[=]() {
+						gate->ms = ms;
+						gate->mode = GATE_MS;
+					}
+				));
+			}
+		}
+	));
+}
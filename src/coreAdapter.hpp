@@ -0,0 +1,44 @@
+#pragma once
+
+//Glue between the Rack modules and the Rack independent core in src/core
+
+#include "plugin.hpp"
+#include "util.hpp"
+#include "core/clock.hpp"
+#include "core/noteBlock.hpp"
+#include "core/markov.hpp"
+#include "core/evolution.hpp"
+#include "core/sequencer.hpp"
+#include "core/stepSequencer.hpp"
+#include "core/scope.hpp"
+
+//Copies blockCount blocks of note block params, starting at baseParamIndex, into pattern.
+//Note timing is read from 4 params per block starting at timingParamIndex, or left on the grid when it is -1.
+void readNoteBlockPattern(Module* module, int baseParamIndex, int blockCount, NoteBlockPattern & pattern, int timingParamIndex = -1);
+
+//Copies the STEP_COUNT duration params starting at durationParamIndex and the length param into pattern
+void readStepPattern(Module* module, int durationParamIndex, int lengthParamIndex, StepPattern & pattern);
+
+//Stages a block into a batch where blockIndex is relative to the batch
+void writeNoteBlock(ParamBatch & batch, int blockIndex, const NoteBlock & block);
+
+json_t* json_markovModel(const MarkovModel & model);
+void json_markovModel_value(json_t* jobj, MarkovModel & model);
+
+json_t* json_geneticSettings(const GeneticSettings & settings);
+void json_geneticSettings_value(json_t* jobj, GeneticSettings & settings);
+
+json_t* json_resetScheduler(const ResetScheduler & reset);
+void json_resetScheduler_value(json_t* jobj, ResetScheduler & reset);
+
+json_t* json_gateSettings(const GateSettings & gate);
+void json_gateSettings_value(json_t* jobj, GateSettings & gate);
+
+//Reads a duration saved in seconds as samples at sampleRate, falling back to an older key that saved raw samples
+int json_samples_value(json_t* jobj, const char* timeKey, const char* samplesKey, float sampleRate);
+
+//Reset timing submenu shared by the sequencers
+void addResetMenu(Menu* menu, ResetScheduler* reset);
+
+//Gate length submenu, only written from the UI thread and read by the audio thread on note starts
+void addGateMenu(Menu* menu, GateSettings* gate);
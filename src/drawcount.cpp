@@ -0,0 +1,84 @@
+#include "drawcount.hpp"
+
+#ifdef JPLAB_DRAWCOUNT
+
+#include "plugin.hpp"
+#include <cmath>
+
+thread_local uint64_t drawCallCount = 0;
+thread_local uint64_t pathPointCount = 0;
+
+//Wrapped with -Wl,--wrap so only calls made from this plugin are seen
+extern "C" {
+	void __real_nvgFill(NVGcontext* ctx);
+	void __real_nvgStroke(NVGcontext* ctx);
+	float __real_nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end);
+	void __real_nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end);
+	void __real_nvgMoveTo(NVGcontext* ctx, float x, float y);
+	void __real_nvgLineTo(NVGcontext* ctx, float x, float y);
+	void __real_nvgBezierTo(NVGcontext* ctx, float c1x, float c1y, float c2x, float c2y, float x, float y);
+	void __real_nvgQuadTo(NVGcontext* ctx, float cx, float cy, float x, float y);
+	void __real_nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, int dir);
+	void __real_nvgRect(NVGcontext* ctx, float x, float y, float w, float h);
+	void __real_nvgRoundedRect(NVGcontext* ctx, float x, float y, float w, float h, float r);
+	void __real_nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry);
+	void __real_nvgCircle(NVGcontext* ctx, float cx, float cy, float r);
+
+	void __wrap_nvgFill(NVGcontext* ctx){
+		drawCallCount++;
+		__real_nvgFill(ctx);
+	}
+	void __wrap_nvgStroke(NVGcontext* ctx){
+		drawCallCount++;
+		__real_nvgStroke(ctx);
+	}
+	float __wrap_nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end){
+		drawCallCount++;
+		return __real_nvgText(ctx, x, y, string, end);
+	}
+	void __wrap_nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end){
+		drawCallCount++;
+		__real_nvgTextBox(ctx, x, y, breakRowWidth, string, end);
+	}
+	void __wrap_nvgMoveTo(NVGcontext* ctx, float x, float y){
+		pathPointCount++;
+		__real_nvgMoveTo(ctx, x, y);
+	}
+	void __wrap_nvgLineTo(NVGcontext* ctx, float x, float y){
+		pathPointCount++;
+		__real_nvgLineTo(ctx, x, y);
+	}
+	void __wrap_nvgBezierTo(NVGcontext* ctx, float c1x, float c1y, float c2x, float c2y, float x, float y){
+		pathPointCount += 3;
+		__real_nvgBezierTo(ctx, c1x, c1y, c2x, c2y, x, y);
+	}
+	void __wrap_nvgQuadTo(NVGcontext* ctx, float cx, float cy, float x, float y){
+		//NanoVG stores a quadratic as a cubic
+		pathPointCount += 3;
+		__real_nvgQuadTo(ctx, cx, cy, x, y);
+	}
+	void __wrap_nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, int dir){
+		//A start point and one bezier per quarter turn, up to 5, as NanoVG splits it
+		int divs = clamp((int) std::round(std::abs(a1 - a0) / (M_PI * 0.5f)), 1, 5);
+		pathPointCount += 1 + divs * 3;
+		__real_nvgArc(ctx, cx, cy, r, a0, a1, dir);
+	}
+	void __wrap_nvgRect(NVGcontext* ctx, float x, float y, float w, float h){
+		pathPointCount += 4;
+		__real_nvgRect(ctx, x, y, w, h);
+	}
+	void __wrap_nvgRoundedRect(NVGcontext* ctx, float x, float y, float w, float h, float r){
+		pathPointCount += r < 0.1f ? 4 : 17;
+		__real_nvgRoundedRect(ctx, x, y, w, h, r);
+	}
+	void __wrap_nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry){
+		pathPointCount += 13;
+		__real_nvgEllipse(ctx, cx, cy, rx, ry);
+	}
+	void __wrap_nvgCircle(NVGcontext* ctx, float cx, float cy, float r){
+		pathPointCount += 13;
+		__real_nvgCircle(ctx, cx, cy, r);
+	}
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+//NanoVG call counter for widget profiling. Build with `make PROFILE=1 DRAWCOUNT=1` (Linux only) to have each profiled
+//phase also report the draw calls and path points it issued. Only this plugin's own NanoVG calls are seen, Rack's panels,
+//knobs and ports draw from inside Rack and aren't counted. Path points are the points handed to the path API, before
+//NanoVG tessellates them into vertices.
+
+#ifdef JPLAB_DRAWCOUNT
+
+#if !defined(__linux__)
+#error "DRAWCOUNT builds rely on GNU ld --wrap and are Linux only"
+#endif
+#ifndef JPLAB_PROFILE
+#error "DRAWCOUNT builds report through the profiler, build with PROFILE=1 as well"
+#endif
+
+#include <cstdint>
+
+//Fills, strokes and text runs issued by this thread
+extern thread_local uint64_t drawCallCount;
+extern thread_local uint64_t pathPointCount;
+
+#endif
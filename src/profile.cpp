@@ -0,0 +1,123 @@
+#include "profile.hpp"
+
+#ifdef JPLAB_PROFILE
+
+void ProfileOverlay::draw(const DrawArgs& args){
+	if(!profiler) return;
+
+	nvgBeginPath(args.vg);
+	nvgRect(args.vg, RECT_ARGS(box.zeroPos()));
+	nvgFillColor(args.vg, nvgRGBA(0x00, 0x00, 0x00, 0xd0));
+	nvgFill(args.vg);
+
+	std::shared_ptr<window::Font> font = APP->window->loadFont(asset::system("res/fonts/ShareTechMono-Regular.ttf"));
+	if(!font) return;
+	nvgFontFaceId(args.vg, font->handle);
+	nvgFontSize(args.vg, 10);
+	nvgTextAlign(args.vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+
+	const float margin = 4;
+	const float rowHeight = (box.size.y - margin) / PROFILE_MAX_PHASES;
+	const float labelWidth = box.size.x * 0.4f;
+	const float barWidth = (box.size.x - labelWidth - margin * 2) / PROFILE_BUCKETS;
+
+	for(int i = 0; i < profiler->phaseCount; i++){
+		float y = margin + rowHeight * i;
+		uint64_t calls = profiler->calls[i].load(std::memory_order_relaxed);
+		uint64_t ticks = profiler->ticks[i].load(std::memory_order_relaxed);
+		double mean = calls > 0 ? ticks / (double) calls : 0;
+
+		nvgFillColor(args.vg, nvgRGB(0xff, 0xff, 0xff));
+		nvgText(args.vg, margin, y, profiler->names[i], NULL);
+		std::string cost = string::f("%.0f cyc", mean);
+#ifdef JPLAB_DRAWCOUNT
+		uint64_t draws = profiler->drawCalls[i].load(std::memory_order_relaxed);
+		uint64_t points = profiler->pathPoints[i].load(std::memory_order_relaxed);
+		if(calls > 0 && (draws > 0 || points > 0)){
+			cost += string::f(" %.0f dc %.0f pt", draws / (double) calls, points / (double) calls);
+		}
+#endif
+		nvgText(args.vg, margin, y + 12, cost.c_str(), NULL);
+
+		uint32_t maxCount = 1;
+		for(int b = 0; b < PROFILE_BUCKETS; b++){
+			maxCount = std::max(maxCount, profiler->histogram[i][b].load(std::memory_order_relaxed));
+		}
+		float barBottom = y + rowHeight - margin;
+		float barMax = rowHeight - margin * 2;
+		nvgBeginPath(args.vg);
+		for(int b = 0; b < PROFILE_BUCKETS; b++){
+			float h = barMax * profiler->histogram[i][b].load(std::memory_order_relaxed) / maxCount;
+			if(h <= 0) continue;
+			nvgRect(args.vg, margin + labelWidth + barWidth * b, barBottom - h, barWidth * 0.8f, h);
+		}
+		nvgFillColor(args.vg, nvgRGB(0xfa, 0x94, 0x50));
+		nvgFill(args.vg);
+	}
+}
+
+json_t* profileSummaryJson(const Profiler & profiler, const std::string & label){
+	json_t* jobj = json_object();
+	json_object_set_new(jobj, "label", json_string(label.c_str()));
+	json_object_set_new(jobj, "time", json_real(system::getUnixTime()));
+	json_t* phasesJ = json_array();
+	for(int i = 0; i < profiler.phaseCount; i++){
+		uint64_t calls = profiler.calls[i].load(std::memory_order_relaxed);
+		uint64_t ticks = profiler.ticks[i].load(std::memory_order_relaxed);
+		json_t* phaseJ = json_object();
+		json_object_set_new(phaseJ, "name", json_string(profiler.names[i]));
+		json_object_set_new(phaseJ, "calls", json_integer(calls));
+		json_object_set_new(phaseJ, "meanCycles", json_real(calls > 0 ? ticks / (double) calls : 0));
+#ifdef JPLAB_DRAWCOUNT
+		uint64_t draws = profiler.drawCalls[i].load(std::memory_order_relaxed);
+		uint64_t points = profiler.pathPoints[i].load(std::memory_order_relaxed);
+		json_object_set_new(phaseJ, "meanDrawCalls", json_real(calls > 0 ? draws / (double) calls : 0));
+		json_object_set_new(phaseJ, "meanPathPoints", json_real(calls > 0 ? points / (double) calls : 0));
+#endif
+		json_t* histogramJ = json_array();
+		for(int b = 0; b < PROFILE_BUCKETS; b++){
+			json_array_append_new(histogramJ, json_integer(profiler.histogram[i][b].load(std::memory_order_relaxed)));
+		}
+		json_object_set_new(phaseJ, "log2Histogram", histogramJ);
+		json_array_append_new(phasesJ, phaseJ);
+	}
+	json_object_set_new(jobj, "phases", phasesJ);
+	return jobj;
+}
+
+std::string appendProfileSummary(const Profiler & profiler, const std::string & label){
+	std::string path = asset::user(PROFILE_SUMMARY_FILE);
+	FILE* file = fopen(path.c_str(), "a");
+	if(!file) return "";
+	json_t* jobj = profileSummaryJson(profiler, label);
+	json_dumpf(jobj, file, JSON_COMPACT);
+	fputc('\n', file);
+	json_decref(jobj);
+	fclose(file);
+	return path;
+}
+
+void addProfileMenu(Menu* menu, Profiler* profiler, ProfileOverlay* overlay, std::string label){
+	menu->addChild(createSubmenuItem(label, "",
+		[=](Menu* menu) {
+			menu->addChild(createMenuItem("Show Overlay", CHECKMARK(overlay->isVisible()),
+				[=]() {
+					overlay->setVisible(!overlay->isVisible());
+				}
+			));
+			menu->addChild(createMenuItem("Reset Counters", "",
+				[=]() {
+					profiler->resetRequested = true;
+				}
+			));
+			menu->addChild(createMenuItem("Save Summary", PROFILE_SUMMARY_FILE,
+				[=]() {
+					std::string path = appendProfileSummary(*profiler, label);
+					INFO("Profile summary %s appended to %s", label.c_str(), path.c_str());
+				}
+			));
+		}
+	));
+}
+
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+
+//Per-phase cycle counters for process(), and for widget frames where a module wants them. Build with `make PROFILE=1` to enable, otherwise
+//the PROFILE_ macros compile away and none of this is included.
+//PROFILE_SCOPE times the rest of its block. PROFILE_PHASE times from there to the next PROFILE_PHASE or the end of the function
+//that called PROFILE_BEGIN, so straight-line code can be split into phases without wrapping it in blocks.
+//Adding DRAWCOUNT=1 also counts the NanoVG draw calls and path points of each phase, see drawcount.hpp.
+
+#ifdef JPLAB_PROFILE
+
+#include "plugin.hpp"
+#include "drawcount.hpp"
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_MAX_PHASES 6
+#define PROFILE_BUCKETS 24 //log2 of cycles per call
+
+inline uint64_t profileTicks(){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+//Written only by the audio thread (or only by the UI thread for widget phases), read by the UI. Relaxed load/store keeps the hot path free of locked instructions.
+struct Profiler{
+	const char* names [PROFILE_MAX_PHASES] = {};
+	int phaseCount = 0;
+	std::atomic<uint64_t> ticks [PROFILE_MAX_PHASES];
+	std::atomic<uint64_t> calls [PROFILE_MAX_PHASES];
+	std::atomic<uint32_t> histogram [PROFILE_MAX_PHASES][PROFILE_BUCKETS];
+#ifdef JPLAB_DRAWCOUNT
+	std::atomic<uint64_t> drawCalls [PROFILE_MAX_PHASES];
+	std::atomic<uint64_t> pathPoints [PROFILE_MAX_PHASES];
+#endif
+	std::atomic<bool> resetRequested;
+
+	Profiler(std::vector<const char*> phaseNames){
+		phaseCount = std::min((int) phaseNames.size(), PROFILE_MAX_PHASES);
+		for(int i = 0; i < phaseCount; i++){
+			names[i] = phaseNames[i];
+		}
+		resetRequested = true;
+		clear();
+	}
+
+	void clear(){
+		for(int i = 0; i < PROFILE_MAX_PHASES; i++){
+			ticks[i].store(0, std::memory_order_relaxed);
+			calls[i].store(0, std::memory_order_relaxed);
+#ifdef JPLAB_DRAWCOUNT
+			drawCalls[i].store(0, std::memory_order_relaxed);
+			pathPoints[i].store(0, std::memory_order_relaxed);
+#endif
+			for(int b = 0; b < PROFILE_BUCKETS; b++){
+				histogram[i][b].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	//Audio thread
+	void add(int phase, uint64_t elapsed){
+		ticks[phase].store(ticks[phase].load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+		calls[phase].store(calls[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		int bucket = elapsed > 0 ? 63 - __builtin_clzll(elapsed) : 0;
+		if(bucket >= PROFILE_BUCKETS) bucket = PROFILE_BUCKETS - 1;
+		histogram[phase][bucket].store(histogram[phase][bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+#ifdef JPLAB_DRAWCOUNT
+	void addDraws(int phase, uint64_t draws, uint64_t points){
+		drawCalls[phase].store(drawCalls[phase].load(std::memory_order_relaxed) + draws, std::memory_order_relaxed);
+		pathPoints[phase].store(pathPoints[phase].load(std::memory_order_relaxed) + points, std::memory_order_relaxed);
+	}
+#endif
+
+	//Audio thread, applies a reset asked for by the UI so the counters keep a single writer
+	void beginProcess(){
+		if(resetRequested.load(std::memory_order_relaxed)){
+			resetRequested.store(false, std::memory_order_relaxed);
+			clear();
+		}
+	}
+};
+
+struct ProfileScope{
+	Profiler & profiler;
+	int phase;
+	uint64_t start;
+#ifdef JPLAB_DRAWCOUNT
+	uint64_t startDraws = drawCallCount;
+	uint64_t startPoints = pathPointCount;
+#endif
+	ProfileScope(Profiler & profiler, int phase) : profiler(profiler), phase(phase){
+		start = profileTicks();
+	}
+	~ProfileScope(){
+		profiler.add(phase, profileTicks() - start);
+#ifdef JPLAB_DRAWCOUNT
+		profiler.addDraws(phase, drawCallCount - startDraws, pathPointCount - startPoints);
+#endif
+	}
+};
+
+//Sequential phases, each one ends where the next starts
+struct ProfilePhases{
+	Profiler & profiler;
+	int phase = -1;
+	uint64_t start = 0;
+	ProfilePhases(Profiler & profiler) : profiler(profiler){
+		profiler.beginProcess();
+	}
+	void next(int nextPhase){
+		uint64_t now = profileTicks();
+		if(phase >= 0) profiler.add(phase, now - start);
+		phase = nextPhase;
+		start = now;
+	}
+	~ProfilePhases(){
+		if(phase >= 0) profiler.add(phase, profileTicks() - start);
+	}
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_BEGIN(profiler) ProfilePhases _profilePhases(profiler)
+#define PROFILE_SCOPE(profiler, phase) ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(profiler, phase)
+#define PROFILE_PHASE(profiler, phase) _profilePhases.next(phase)
+
+//Mean cycles and a log2 histogram per phase, drawn over the panel. DRAWCOUNT builds add mean draw calls and path points.
+struct ProfileOverlay : widget::TransparentWidget{
+	Profiler* profiler = NULL;
+
+	void draw(const DrawArgs& args) override;
+};
+
+//Calls, mean cycles and the histogram of each phase, so runs can be compared outside Rack. DRAWCOUNT builds add
+//meanDrawCalls and meanPathPoints.
+json_t* profileSummaryJson(const Profiler & profiler, const std::string & label);
+
+//Appends one profileSummaryJson line to PROFILE_SUMMARY_FILE in the Rack user folder and returns its path
+#define PROFILE_SUMMARY_FILE "JPLab-profile.jsonl"
+std::string appendProfileSummary(const Profiler & profiler, const std::string & label);
+
+void addProfileMenu(Menu* menu, Profiler* profiler, ProfileOverlay* overlay, std::string label = "Profiling");
+
+#else
+
+#define PROFILE_BEGIN(profiler)
+#define PROFILE_SCOPE(profiler, phase)
+#define PROFILE_PHASE(profiler, phase)
+
+#endif
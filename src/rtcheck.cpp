@@ -0,0 +1,135 @@
+#include "rtcheck.hpp"
+
+#ifdef JPLAB_RTCHECK
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <dlfcn.h>
+#include <pthread.h>
+
+thread_local int rtcheckDepth = 0;
+
+enum RtCheckKind{
+	RT_MALLOC,
+	RT_FREE,
+	RT_NEW,
+	RT_DELETE,
+	RT_MUTEX,
+	RT_KIND_COUNT,
+};
+
+static const char* RT_KIND_LABELS[RT_KIND_COUNT] = {"malloc", "free", "new", "delete", "mutex lock"};
+
+#define RTCHECK_MAX_SITES 256
+
+//Fixed open addressed table so recording never allocates or locks itself
+struct RtCheckSite{
+	std::atomic<void*> address;
+	std::atomic<int> kind;
+	std::atomic<uint32_t> count;
+};
+
+static RtCheckSite sites [RTCHECK_MAX_SITES];
+static std::atomic<uint32_t> droppedSites(0);
+
+static void rtcheckFlag(RtCheckKind kind, void* address){
+	if(rtcheckDepth <= 0) return;
+	uintptr_t hash = ((uintptr_t) address >> 2) * 2654435761u + kind;
+	for(int i = 0; i < RTCHECK_MAX_SITES; i++){
+		RtCheckSite & site = sites[(hash + i) % RTCHECK_MAX_SITES];
+		void* current = site.address.load(std::memory_order_acquire);
+		if(current == NULL){
+			void* expected = NULL;
+			if(site.address.compare_exchange_strong(expected, address, std::memory_order_acq_rel)){
+				site.kind.store(kind, std::memory_order_relaxed);
+			}
+			current = site.address.load(std::memory_order_acquire);
+		}
+		if(current == address && site.kind.load(std::memory_order_relaxed) == kind){
+			site.count.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+	droppedSites.fetch_add(1, std::memory_order_relaxed);
+}
+
+void rtcheckReport(){
+	int found = 0;
+	for(int i = 0; i < RTCHECK_MAX_SITES; i++){
+		RtCheckSite & site = sites[i];
+		void* address = site.address.load(std::memory_order_acquire);
+		uint32_t count = site.count.load(std::memory_order_relaxed);
+		if(address == NULL || count == 0) continue;
+		if(found == 0) std::fprintf(stderr, "JPLab RTCHECK: calls made inside process()\n");
+		found++;
+
+		Dl_info info;
+		const char* symbol = "?";
+		uintptr_t offset = 0;
+		if(dladdr(address, &info) && info.dli_sname){
+			symbol = info.dli_sname;
+			offset = (uintptr_t) address - (uintptr_t) info.dli_saddr;
+		}
+		std::fprintf(stderr, "  %-10s x%u at %p %s+0x%lx\n", RT_KIND_LABELS[site.kind.load()], count, address, symbol, (unsigned long) offset);
+	}
+	if(found == 0) std::fprintf(stderr, "JPLab RTCHECK: no allocations or locks inside process()\n");
+	if(droppedSites > 0) std::fprintf(stderr, "JPLab RTCHECK: %u calls from sites past the table size were not recorded\n", droppedSites.load());
+}
+
+__attribute__((destructor)) static void rtcheckReportOnUnload(){
+	rtcheckReport();
+}
+
+//Wrapped with -Wl,--wrap so only calls made from this plugin are seen
+extern "C" {
+	void* __real_malloc(size_t size);
+	void* __real_calloc(size_t count, size_t size);
+	void* __real_realloc(void* ptr, size_t size);
+	void __real_free(void* ptr);
+	void* __real__Znwm(size_t size);
+	void* __real__Znam(size_t size);
+	void __real__ZdlPv(void* ptr);
+	void __real__ZdaPv(void* ptr);
+	int __real_pthread_mutex_lock(pthread_mutex_t* mutex);
+
+	void* __wrap_malloc(size_t size){
+		rtcheckFlag(RT_MALLOC, __builtin_return_address(0));
+		return __real_malloc(size);
+	}
+	void* __wrap_calloc(size_t count, size_t size){
+		rtcheckFlag(RT_MALLOC, __builtin_return_address(0));
+		return __real_calloc(count, size);
+	}
+	void* __wrap_realloc(void* ptr, size_t size){
+		rtcheckFlag(RT_MALLOC, __builtin_return_address(0));
+		return __real_realloc(ptr, size);
+	}
+	void __wrap_free(void* ptr){
+		if(ptr) rtcheckFlag(RT_FREE, __builtin_return_address(0));
+		__real_free(ptr);
+	}
+	void* __wrap__Znwm(size_t size){
+		rtcheckFlag(RT_NEW, __builtin_return_address(0));
+		return __real__Znwm(size);
+	}
+	void* __wrap__Znam(size_t size){
+		rtcheckFlag(RT_NEW, __builtin_return_address(0));
+		return __real__Znam(size);
+	}
+	void __wrap__ZdlPv(void* ptr){
+		if(ptr) rtcheckFlag(RT_DELETE, __builtin_return_address(0));
+		__real__ZdlPv(ptr);
+	}
+	void __wrap__ZdaPv(void* ptr){
+		if(ptr) rtcheckFlag(RT_DELETE, __builtin_return_address(0));
+		__real__ZdaPv(ptr);
+	}
+	int __wrap_pthread_mutex_lock(pthread_mutex_t* mutex){
+		rtcheckFlag(RT_MUTEX, __builtin_return_address(0));
+		return __real_pthread_mutex_lock(mutex);
+	}
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+//Real-time safety checker. Build with `make RTCHECK=1` (Linux only) to have every malloc, free, new, delete and
+//mutex lock made while a thread is inside a module's process() recorded by call site and summarized on exit.
+//Otherwise RTCHECK_SCOPE compiles away.
+
+#ifdef JPLAB_RTCHECK
+
+#if !defined(__linux__)
+#error "RTCHECK builds rely on GNU ld --wrap and are Linux only"
+#endif
+
+extern thread_local int rtcheckDepth;
+
+struct RtCheckScope{
+	RtCheckScope(){
+		rtcheckDepth++;
+	}
+	~RtCheckScope(){
+		rtcheckDepth--;
+	}
+};
+
+//Writes the summary to stderr. Also runs automatically when the plugin is unloaded.
+void rtcheckReport();
+
+#define RTCHECK_SCOPE() RtCheckScope _rtcheckScope
+
+#else
+
+#define RTCHECK_SCOPE()
+
+#endif
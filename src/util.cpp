@@ -24,7 +24,7 @@ void json_vecArray_value(json_t* jArray, Vec * array, int length){
 }
 
 
-json_t* json_floatArray(float * array, int length){
+json_t* json_floatArray(const float * array, int length){
 	json_t *jArray = json_array();
 	for(int i = 0; i < length; i++){
 		json_array_insert_new(jArray, i, json_real(array[i]));
@@ -45,4 +45,47 @@ float mod_0_max(float val, float max){
 int mod_0_max(int val, int max){
 	int whole = std::floor((float)val/max);
 	return val - whole * max;
+}
+
+ParamBatch::ParamBatch(Module* module, int firstParamId, int count){
+	this->module = module;
+	this->firstParamId = firstParamId;
+	this->count = count;
+	oldValues.resize(count);
+	for(int i = 0; i < count; i++){
+		oldValues[i] = module->params[firstParamId + i].getValue();
+	}
+	newValues = oldValues;
+}
+
+int ParamBatch::commit(std::string historyName){
+	history::ComplexAction* action = NULL;
+	if(historyName != ""){
+		action = new history::ComplexAction;
+		action->name = historyName;
+	}
+
+	int changed = 0;
+	for(int i = 0; i < count; i++){
+		if(newValues[i] == oldValues[i]) continue;
+		module->params[firstParamId + i].setValue(newValues[i]);
+		changed++;
+
+		if(action){
+			history::ParamChange* paramChange = new history::ParamChange;
+			paramChange->moduleId = module->id;
+			paramChange->paramId = firstParamId + i;
+			paramChange->oldValue = oldValues[i];
+			paramChange->newValue = newValues[i];
+			action->push(paramChange);
+		}
+	}
+
+	if(action){
+		if(action->isEmpty()) delete action;
+		else APP->history->push(action);
+	}
+
+	oldValues = newValues;
+	return changed;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "plugin.hpp"
+#include "core/clock.hpp"
 
 #define PI 3.141592f
 #define TWO_PI 6.283185f
@@ -70,7 +71,7 @@ json_t* json_bool(bool value);
 json_t* json_vecArray(Vec * array, int length);
 void json_vecArray_value(json_t* jArray, Vec * array, int length);
 
-json_t* json_floatArray(float * array, int length);
+json_t* json_floatArray(const float * array, int length);
 void json_floatArray_value(json_t* jArray, float * array, int length);
 
 //void profile(int index);
@@ -78,46 +79,24 @@ void json_floatArray_value(json_t* jArray, float * array, int length);
 float mod_0_max(float val, float max);
 int mod_0_max(int val, int max);
 
-inline void schmittTrigger(bool & state, float input, bool & highEvent, bool & lowEvent){
-	if(!state && input >= 2.0f){
-		state = true;
-		highEvent = true;
-	}else if(state && input <= 0.1f){
-		state = false;
-		lowEvent = true;
-	}
+inline int rndInt(int max){
+	return std::floor(rack::random::uniform() * max);
 }
 
-inline bool schmittTrigger(bool & state, float input){
-	if(!state && input >= 2.0f){
-		state = true;
-		return true;
-	}else if(state && input <= 0.1f){
-		state = false;
-		return false;
-	}
-	return false;
-}
+//Stages edits to a contiguous run of params so they can be written in one pass and undone as a single history step
+struct ParamBatch {
+	Module* module;
+	int firstParamId;
+	int count;
+	std::vector<float> oldValues;
+	std::vector<float> newValues;
 
-inline bool buttonTrigger(bool & state, float input){
-	if(!state && input >= 1.0f){
-		state = true;
-		return true;
-	}else if(state && input <= 0.f){
-		state = false;
-		return false;
-	}
-	return false;
-}
+	ParamBatch(Module* module, int firstParamId, int count);
 
-inline void countClockLength(int & clockCounter, int & clockLength, bool clockHighEvent){
-	if(clockHighEvent){
-		clockLength = clockCounter;
-		clockCounter = 0;
-	}
-	clockCounter++;
-}
+	//Indexes are relative to firstParamId
+	float getValue(int i){ return newValues[i]; }
+	void setValue(int i, float value){ newValues[i] = value; }
 
-inline int rndInt(int max){
-	return std::floor(rack::random::uniform() * max);
-}
\ No newline at end of file
+	//Writes only the params that changed. Pushes one history action when historyName is set.
+	int commit(std::string historyName = "");
+};
\ No newline at end of file
@@ -17,162 +17,401 @@ void configNoteBlock(Module * module, int paramIndex, bool firstBlock){
 	}
 }
 
-int getNoteIndexForPulse(int blockType, int pulseInBlock){
-	switch(blockType){
-		//Whole Note
-		case 1:
-		default:
-			return 0;
-
-		//Half Notes
-		case 2:
-			return (pulseInBlock / 12) * 2;
-
-		//Quater - Quater - Half
-		case 3:
-			if(pulseInBlock >= 12) return 2;
-			return pulseInBlock / 6;
-
-		//Quater - Half - Quarter
-		case 4:
-			if(pulseInBlock >= 18) return 3;
-			else if(pulseInBlock >= 6) return 1;
-			return 0;
-
-		//Half - Quarter - Quarter
-		case 5:
-			if(pulseInBlock < 12) return 0;
-			return pulseInBlock / 6;
-
-		//Tipplets
-		case 6:
-			return pulseInBlock / 8;
-
-		//Quarter Notes
-		case 7:
-			return pulseInBlock / 6;
+NoteMenuPool::~NoteMenuPool(){
+	if(!keyboard) return;
+	PooledKeyboardMenu* menu = dynamic_cast<PooledKeyboardMenu*>(keyboard->Widget::parent);
+	if(menu){
+		//Still open, the menu deletes the keyboard when it closes
+		menu->pool = NULL;
+	}else{
+		delete keyboard;
 	}
 }
 
-bool getGateHigh(int blockType, int pulseInBlock){
-	switch(blockType){
-		//Whole Note
-		case 1:
-		default:
-			return 0 == (pulseInBlock / 12);
-
-		//Half Notes
-		case 2:
-			return 0 == ((pulseInBlock / 6) % 2);
-
-		//Quater - Quater - Half
-		case 3:
-			if(pulseInBlock >= 12) return pulseInBlock < 18;
-			return 0 == ((pulseInBlock / 3) % 2);
-
-		//Quater - Half - Quarter
-		case 4:
-			if(pulseInBlock >= 18) return pulseInBlock < 21;
-			else if(pulseInBlock >= 6) return pulseInBlock < 12;
-			return pulseInBlock < 3;
-
-		//Half - Quarter - Quarter
-		case 5:
-			if(pulseInBlock < 12) return pulseInBlock < 6;
-			return 0 == ((pulseInBlock / 3) % 2);
-
-		//Tipplets
-		case 6:
-			return 0 == ((pulseInBlock / 4) % 2);
-
-		//Quarter Notes
-		case 7:
-			return 0 == ((pulseInBlock / 3) % 2);
+NoteEntryWidgetMenu* NoteMenuPool::take(NoteControler* target){
+	if(!keyboard){
+		keyboard = createWidget<NoteEntryWidgetMenu>(mm2px(Vec(0, 0)));
+		keyboard->init();
+	}else if(keyboard->Widget::parent){
+		//The last menu is closed but not deleted yet
+		PooledKeyboardMenu* menu = dynamic_cast<PooledKeyboardMenu*>(keyboard->Widget::parent);
+		if(menu) menu->pool = NULL;
+		keyboard->Widget::parent->removeChild(keyboard);
 	}
+	keyboard->parent = target;
+	return keyboard;
 }
 
-int lastNoteIndex(int blockType){
-	return getNoteIndexForPulse(blockType,23);
+PooledKeyboardMenu::~PooledKeyboardMenu(){
+	if(pool && pool->keyboard && pool->keyboard->Widget::parent == this) removeChild(pool->keyboard);
 }
 
-int nextNoteIndex(int blockType, int noteIndex){
-	switch(blockType){
-		//Half Notes
-		case 2:
-			return noteIndex + 2;
-
-		//Quater - Half - Quarter
-		case 4:
-			if(noteIndex == 1) return 3;
-			break;
-
-		//Half - Quarter - Quarter
-		case 5:
-			if(noteIndex == 0) return 2;
-			break;
+const NoteExtraSvgs & noteExtraSvgs(){
+	static NoteExtraSvgs svgs;
+	if(!svgs.mute){
+		svgs.mute = Svg::load(asset::plugin(pluginInstance,"res/mute_off.svg"));
+		svgs.tie = Svg::load(asset::plugin(pluginInstance,"res/tie_off.svg"));
 	}
-	return noteIndex + 1;
+	return svgs;
 }
 
-void getNoteAndBlock(Module* module, int baseParamIndex, int pulse, int& block, int& noteIndex){
-	if(pulse < 0){
-		block = -1;
-		noteIndex = -1;
-		return;
+void RingLightBatch::step(){
+	float decay = APP->window->getLastFrameDuration() / TRAIL_TIME;
+	for(Ring & ring : rings){
+		NVGcolor color = ring.note->knob->ring->color;
+		if(color.a > 0){
+			ring.trail = 1;
+			ring.trailColor = color;
+		}else if(ring.trail > 0){
+			ring.trail = std::max(ring.trail - decay, 0.f);
+		}
 	}
-	block = pulse / 24;
-	int pulseInBlock = pulse - block * 24;
-	int blockParamIndex = baseParamIndex + block * NOTE_BLOCK_PARAM_COUNT;
-	int blockType = static_cast<int>(module->params[blockParamIndex].getValue());
-	noteIndex = getNoteIndexForPulse(blockType,pulseInBlock);
+	TransparentWidget::step();
+}
+
+static bool sameColor(const NVGcolor & a, const NVGcolor & b){
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
 }
 
-void getOuputValues(Module* module, int baseParamIndex, int pulse, float& cv, bool& updateCV, bool& gateHigh)
-{	
-	if(pulse < 0){
-		cv = 0;
-		updateCV = false;
-		gateHigh = false;
-		return;
+void RingLightBatch::drawLayer(const DrawArgs& args, int layer){
+	TransparentWidget::drawLayer(args, layer);
+	if(layer != 1) return;
+
+	for(size_t gi = 0; gi < groupCount; gi++){
+		groups[gi].centers.clear();
 	}
-	int block = pulse / 24;
-	int pulseInBlock = pulse - block * 24;
-	int blockParamIndex = baseParamIndex + block * NOTE_BLOCK_PARAM_COUNT;
-	int blockType = static_cast<int>(module->params[blockParamIndex].getValue());
-	int noteIndex = getNoteIndexForPulse(blockType,pulseInBlock);
-
-	cv = module->params[blockParamIndex + 1 + noteIndex * 2].getValue();
-	NoteExtra extra = static_cast<NoteExtra>(module->params[blockParamIndex + 2 + noteIndex * 2].getValue());
-	updateCV = extra == NE_NONE;
-	if(extra == NE_MUTE){
-		gateHigh = false;
-	}else{
-		//Check for Tie in next note
-		int block2 = block;
-		int noteIndex2 = noteIndex;
-		getNextNote(module,baseParamIndex,block2,noteIndex2);
-		int blockParamIndex2 = baseParamIndex + block2 * NOTE_BLOCK_PARAM_COUNT;
-		bool nextIsTie = NE_TIE == static_cast<NoteExtra>(module->params[blockParamIndex2 + 2 + noteIndex2 * 2].getValue());
-		if(nextIsTie){
-			gateHigh = true;
-		}else{
-			gateHigh = getGateHigh(blockType,pulseInBlock);
+	groupCount = 0;
+
+	float radiusA = 0;
+	for(Ring & ring : rings){
+		TrimpotRingLight* light = ring.note->knob->ring;
+		NVGcolor color = light->color;
+		if(color.a <= 0){
+			if(!trails || ring.trail <= 0) continue;
+			//Few alpha steps so fading rings still share paths
+			color = ring.trailColor;
+			color.a *= std::ceil(ring.trail * TRAIL_LEVELS) / TRAIL_LEVELS * 0.5f;
+		}
+		if(!ring.note->showsKnob()) continue;
+
+		size_t gi = 0;
+		while(gi < groupCount && !sameColor(groups[gi].color, color)) gi++;
+		if(gi == groupCount){
+			if(groupCount == groups.size()) groups.push_back(ColorGroup());
+			groups[gi].color = color;
+			groupCount++;
+		}
+		math::Vec center = light->getRelativeOffset(light->box.size.div(2), Widget::parent).minus(box.pos);
+		groups[gi].centers.push_back(center);
+		radiusA = std::min(light->box.size.x, light->box.size.y) / 2.0;
+	}
+
+	float radiusB = radiusA * 0.75f;
+	for(size_t gi = 0; gi < groupCount; gi++){
+		nvgBeginPath(args.vg);
+		for(const math::Vec & center : groups[gi].centers){
+			nvgCircle(args.vg, center.x, center.y, radiusA);
+			nvgCircle(args.vg, center.x, center.y, radiusB);
+			nvgPathWinding(args.vg, NVG_HOLE);
 		}
+		nvgFillColor(args.vg, groups[gi].color);
+		nvgFill(args.vg);
 	}
+}
 
+bool PianoRollColumnState::operator==(const PianoRollColumnState & other) const{
+	if(subdivision != other.subdivision || active != other.active) return false;
+	for(int ni = 0; ni < 4; ni++){
+		if(pitch[ni] != other.pitch[ni] || extra[ni] != other.extra[ni]) return false;
+	}
+	if(ghost != other.ghost) return false;
+	if(!ghost) return true;
+	if(ghostSubdivision != other.ghostSubdivision) return false;
+	for(int ni = 0; ni < 4; ni++){
+		if(ghostPitch[ni] != other.ghostPitch[ni] || ghostExtra[ni] != other.ghostExtra[ni]) return false;
+	}
+	return true;
 }
 
-void getNextNote(Module* module, int baseParamIndex, int& block, int& noteIndex){
-	int blockParamIndex = baseParamIndex + block * NOTE_BLOCK_PARAM_COUNT;
-	int blockType = static_cast<int>(module->params[blockParamIndex].getValue());
-	if(lastNoteIndex(blockType) == noteIndex){
-		block++;
-		noteIndex=0;
-	}else{
-		blockParamIndex = baseParamIndex + block * NOTE_BLOCK_PARAM_COUNT;
-		blockType = static_cast<int>(module->params[blockParamIndex].getValue());
-		noteIndex = nextNoteIndex(blockType,noteIndex);
+void PianoRollColumn::draw(const DrawArgs& args){
+	const NVGcolor BG_COLORS[] = {nvgRGB(0xcc, 0xcc, 0xcc), nvgRGB(0xb8, 0xb8, 0xb8)};
+	const float height = box.size.y;
+	const float pulseWidth = box.size.x / PULSES_PER_BLOCK;
+	const float rowHeight = height / PianoRollWidget::pitchRows();
+
+	nvgBeginPath(args.vg);
+	nvgRect(args.vg, RECT_ARGS(box.zeroPos()));
+	nvgFillColor(args.vg, state.active ? BG_COLORS[index % 2] : COLOR_WHITE_NOTE_BASE);
+	nvgFill(args.vg);
+
+	//A line under every C
+	nvgBeginPath(args.vg);
+	for(int semi = std::ceil(NOTE_CV_MIN * 12); semi <= NOTE_CV_MAX * 12; semi++){
+		if(semi % 12 != 0) continue;
+		float y = PianoRollWidget::pitchToY(semi / 12.f, height) + rowHeight;
+		nvgRect(args.vg, 0, y - 0.5f, box.size.x, 0.5f);
+	}
+	nvgFillColor(args.vg, nvgRGBA(0x00, 0x00, 0x00, 0x30));
+	nvgFill(args.vg);
+
+	if(state.ghost && state.ghostSubdivision >= SubDiv_Quarter){
+		nvgBeginPath(args.vg);
+		int pi = 0;
+		while(pi < PULSES_PER_BLOCK){
+			int ni = getNoteIndexForPulse(state.ghostSubdivision, pi);
+			int length = 1;
+			while(pi + length < PULSES_PER_BLOCK && getNoteIndexForPulse(state.ghostSubdivision, pi + length) == ni) length++;
+			if(state.ghostExtra[ni] != NE_MUTE){
+				nvgRect(args.vg, pi * pulseWidth, PianoRollWidget::pitchToY(state.ghostPitch[ni], height), length * pulseWidth - 1, rowHeight);
+			}
+			pi += length;
+		}
+		nvgFillColor(args.vg, nvgTransRGBA(COLOR_EVOLVED, 0x60));
+		nvgFill(args.vg);
+	}
+
+	if(state.subdivision < SubDiv_Quarter) return;
+
+	//Notes in one path and rests in another
+	nvgBeginPath(args.vg);
+	int pi = 0;
+	while(pi < PULSES_PER_BLOCK){
+		int ni = getNoteIndexForPulse(state.subdivision, pi);
+		int length = 1;
+		while(pi + length < PULSES_PER_BLOCK && getNoteIndexForPulse(state.subdivision, pi + length) == ni) length++;
+		if(state.extra[ni] != NE_MUTE){
+			//Ties join the note before them, everything else leaves a gap so repeated notes read apart
+			float x = pi * pulseWidth;
+			float w = length * pulseWidth - 1;
+			if(state.extra[ni] == NE_TIE){
+				x -= 1;
+				w += 1;
+			}
+			nvgRect(args.vg, x, PianoRollWidget::pitchToY(state.pitch[ni], height), w, rowHeight);
+		}
+		pi += length;
+	}
+	nvgFillColor(args.vg, state.active ? COLOR_MARGIN : COLOR_BLACK_NOTE_BASE);
+	nvgFill(args.vg);
+
+	nvgBeginPath(args.vg);
+	pi = 0;
+	while(pi < PULSES_PER_BLOCK){
+		int ni = getNoteIndexForPulse(state.subdivision, pi);
+		int length = 1;
+		while(pi + length < PULSES_PER_BLOCK && getNoteIndexForPulse(state.subdivision, pi + length) == ni) length++;
+		if(state.extra[ni] == NE_MUTE){
+			nvgRect(args.vg, pi * pulseWidth + 0.5f, PianoRollWidget::pitchToY(state.pitch[ni], height) + 0.5f, length * pulseWidth - 2, rowHeight - 1);
+		}
+		pi += length;
+	}
+	nvgStrokeColor(args.vg, COLOR_BLACK_NOTE_BASE);
+	nvgStrokeWidth(args.vg, 1);
+	nvgStroke(args.vg);
+}
+
+void PianoRollWidget::init(Module* module, int baseParamIndex){
+	this->module = module;
+	this->baseParamIndex = baseParamIndex;
+	float columnWidth = box.size.x / CORE_MAX_BLOCKS;
+	for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++){
+		columnCache[bi] = new widget::FramebufferWidget;
+		columnCache[bi]->box.pos = Vec(columnWidth * bi, 0);
+		columnCache[bi]->box.size = Vec(columnWidth, box.size.y);
+		columns[bi] = new PianoRollColumn;
+		columns[bi]->index = bi;
+		columns[bi]->box.size = columnCache[bi]->box.size;
+		columnCache[bi]->addChild(columns[bi]);
+		addChild(columnCache[bi]);
+	}
+}
+
+int PianoRollWidget::pitchRows(){
+	return (int) std::round((NOTE_CV_MAX - NOTE_CV_MIN) * 12) + 1;
+}
+
+float PianoRollWidget::pitchToY(float cv, float height){
+	int row = (int) std::round((NOTE_CV_MAX - cv) * 12);
+	return clamp(row, 0, pitchRows() - 1) * height / pitchRows();
+}
+
+void PianoRollWidget::columnNotes(const NoteBlock & block, float & prevPitch, float* pitch, NoteExtra* extra){
+	int pi = 0;
+	while(block.subdivision >= SubDiv_Quarter && pi < PULSES_PER_BLOCK){
+		int ni = getNoteIndexForPulse(block.subdivision, pi);
+		extra[ni] = block.extra[ni];
+		pitch[ni] = block.extra[ni] == NE_TIE ? prevPitch : block.cv[ni];
+		if(block.extra[ni] != NE_MUTE) prevPitch = pitch[ni];
+		while(pi < PULSES_PER_BLOCK && getNoteIndexForPulse(block.subdivision, pi) == ni) pi++;
+	}
+}
+
+void PianoRollWidget::step(){
+	OpaqueWidget::step();
+	if(!module || !isVisible()) return;
+
+	NoteBlockPattern pattern;
+	readNoteBlockPattern(module, baseParamIndex, CORE_MAX_BLOCKS, pattern);
+
+	float prevPitch = 0;
+	for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++){
+		const NoteBlock & block = pattern.blocks[bi];
+		PianoRollColumnState state;
+		state.subdivision = block.subdivision;
+		state.active = bi < blockCount;
+		int ghost = ghostBlock[bi];
+		if(ghost >= 0 && ghost < CORE_MAX_BLOCKS && ghost != bi){
+			//Ties in the ghost continue from the note before this column, as they would when it plays here
+			float ghostPrevPitch = prevPitch;
+			state.ghost = true;
+			state.ghostSubdivision = pattern.blocks[ghost].subdivision;
+			columnNotes(pattern.blocks[ghost], ghostPrevPitch, state.ghostPitch, state.ghostExtra);
+		}
+		//Walk the notes in play order so ties pick up the pitch before them, across blocks too
+		columnNotes(block, prevPitch, state.pitch, state.extra);
+		if(columns[bi]->state != state){
+			columns[bi]->state = state;
+			columnCache[bi]->setDirty();
+		}
+	}
+}
+
+void PianoRollWidget::drawLayer(const DrawArgs& args, int layer){
+	OpaqueWidget::drawLayer(args, layer);
+	if(layer != 1 || playPulse < 0) return;
+
+	const float pulseWidth = box.size.x / CORE_MAX_BLOCKS / PULSES_PER_BLOCK;
+	if(evolvedPulse >= 0){
+		//Shade the block evolution is playing from, and mark where in it
+		int block = evolvedPulse / PULSES_PER_BLOCK;
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, block * PULSES_PER_BLOCK * pulseWidth, 0, PULSES_PER_BLOCK * pulseWidth, box.size.y);
+		nvgFillColor(args.vg, nvgTransRGBA(COLOR_EVOLVED, 0x40));
+		nvgFill(args.vg);
+
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, evolvedPulse * pulseWidth, 0, 1.5f, box.size.y);
+		nvgFillColor(args.vg, COLOR_EVOLVED);
+		nvgFill(args.vg);
+	}
+
+	nvgBeginPath(args.vg);
+	nvgRect(args.vg, playPulse * pulseWidth, 0, 1.5f, box.size.y);
+	nvgFillColor(args.vg, evolvedPulse >= 0 ? COLOR_ACTIVE_GHOST_NOTE : COLOR_ACTIVE_NOTE);
+	nvgFill(args.vg);
+}
+
+void PianoRollWidget::onButton(const ButtonEvent& e){
+	if(module && e.action == GLFW_PRESS && e.button == GLFW_MOUSE_BUTTON_LEFT && (e.mods & RACK_MOD_MASK) == 0){
+		dragParamId = -1;
+		float columnWidth = box.size.x / CORE_MAX_BLOCKS;
+		int bi = clamp((int) (e.pos.x / columnWidth), 0, CORE_MAX_BLOCKS - 1);
+		int pi = clamp((int) ((e.pos.x - bi * columnWidth) / columnWidth * PULSES_PER_BLOCK), 0, PULSES_PER_BLOCK - 1);
+		const PianoRollColumnState & state = columns[bi]->state;
+		if(state.subdivision >= SubDiv_Quarter){
+			int ni = getNoteIndexForPulse(state.subdivision, pi);
+			//Mutes and ties have no pitch of their own to drag
+			if(state.extra[ni] == NE_NONE){
+				dragParamId = baseParamIndex + bi * NOTE_BLOCK_PARAM_COUNT + 1 + ni * 2;
+				dragStartCV = module->params[dragParamId].getValue();
+				dragY = 0;
+			}
+		}
+	}
+	OpaqueWidget::onButton(e);
+}
+
+void PianoRollWidget::onDragMove(const DragMoveEvent& e){
+	if(dragParamId < 0) return;
+	dragY += e.mouseDelta.y / getAbsoluteZoom();
+	float rowHeight = box.size.y / pitchRows();
+	float cv = dragStartCV - std::round(dragY / rowHeight) / 12.f;
+	module->params[dragParamId].setValue(clamp(cv, NOTE_CV_MIN, NOTE_CV_MAX));
+}
+
+void PianoRollWidget::onDragEnd(const DragEndEvent& e){
+	if(dragParamId < 0) return;
+	float cv = module->params[dragParamId].getValue();
+	if(cv != dragStartCV){
+		history::ParamChange* action = new history::ParamChange;
+		action->name = "piano roll edit";
+		action->moduleId = module->id;
+		action->paramId = dragParamId;
+		action->oldValue = dragStartCV;
+		action->newValue = cv;
+		APP->history->push(action);
+	}
+	dragParamId = -1;
+}
+
+void OutputScopeWidget::draw(const DrawArgs& args){
+	nvgBeginPath(args.vg);
+	nvgRoundedRect(args.vg, 0, 0, box.size.x, box.size.y, 2);
+	nvgFillColor(args.vg, COLOR_MARGIN);
+	nvgFill(args.vg);
+	Widget::draw(args);
+}
+
+void OutputScopeWidget::drawLayer(const DrawArgs& args, int layer){
+	Widget::drawLayer(args, layer);
+	if(layer != 1 || !ring) return;
+
+	int count = ring->read(samples, SCOPE_PULSES);
+	if(count == 0) return;
+
+	//Newest pulse on the right edge, a partly filled ring leaves the left empty
+	int columns = clamp((int) (box.size.x / 2), 1, SCOPE_PULSES);
+	int skipped = SCOPE_PULSES - count;
+	int firstColumn = columns;
+	for(int c = 0; c < columns; c++){
+		int from = std::max(c * SCOPE_PULSES / columns - skipped, 0);
+		int to = (c + 1) * SCOPE_PULSES / columns - skipped;
+		if(to <= from) continue;
+		if(firstColumn == columns) firstColumn = c;
+		columnMin[c] = columnMax[c] = samples[from].cv;
+		columnGate[c] = false;
+		for(int si = from; si < to; si++){
+			columnMin[c] = std::min(columnMin[c], samples[si].cv);
+			columnMax[c] = std::max(columnMax[c], samples[si].cv);
+			columnGate[c] = columnGate[c] || samples[si].gate;
+		}
+	}
+	if(firstColumn == columns) return;
+
+	const float margin = 2;
+	const float columnWidth = (box.size.x - margin * 2) / columns;
+	const float gateHeight = box.size.y * 0.15f;
+	const float cvTop = margin;
+	const float cvHeight = box.size.y - gateHeight - margin * 3;
+	auto cvToY = [&](float cv){
+		return cvTop + cvHeight * clamp((NOTE_CV_MAX - cv) / (NOTE_CV_MAX - NOTE_CV_MIN), 0.f, 1.f);
+	};
+
+	//Runs of high gate as one rect each
+	nvgBeginPath(args.vg);
+	int runStart = -1;
+	for(int c = firstColumn; c <= columns; c++){
+		bool high = c < columns && columnGate[c];
+		if(high && runStart < 0) runStart = c;
+		if(!high && runStart >= 0){
+			nvgRect(args.vg, margin + runStart * columnWidth, box.size.y - margin - gateHeight, (c - runStart) * columnWidth - 1, gateHeight);
+			runStart = -1;
+		}
+	}
+	nvgFillColor(args.vg, COLOR_LAST_NOTE);
+	nvgFill(args.vg);
+
+	nvgBeginPath(args.vg);
+	nvgMoveTo(args.vg, margin + firstColumn * columnWidth, cvToY(columnMax[firstColumn]));
+	for(int c = firstColumn; c < columns; c++){
+		float x = margin + c * columnWidth;
+		nvgLineTo(args.vg, x, cvToY(columnMax[c]));
+		nvgLineTo(args.vg, x, cvToY(columnMin[c]));
+		nvgLineTo(args.vg, x + columnWidth, cvToY(columnMin[c]));
 	}
+	nvgStrokeColor(args.vg, COLOR_ACTIVE_NOTE);
+	nvgStrokeWidth(args.vg, 1.5f);
+	nvgStroke(args.vg);
 }
 
 #define DEBUG_ONLY(x)
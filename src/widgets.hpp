@@ -2,6 +2,7 @@
 
 #include "rack.hpp"
 #include "util.hpp"
+#include "coreAdapter.hpp"
 
 using namespace rack;
 
@@ -22,10 +23,8 @@ struct ColoredSvgWidget : widget::SvgWidget
 	}
 };
 
-#define ROOT_OFFSET 7.f/12.f
-#define NoteEntryWidget_MIN (-1.f - ROOT_OFFSET)
-#define NoteEntryWidget_MAX (2.f - ROOT_OFFSET - 1.f/12.f)
-#define NOTE_BLOCK_PARAM_COUNT 9
+#define NoteEntryWidget_MIN NOTE_CV_MIN
+#define NoteEntryWidget_MAX NOTE_CV_MAX
 
 static const int NoteEntryWidget_OFF = -19;
 
@@ -41,28 +40,6 @@ static const NVGcolor COLOR_WHITE_NOTE_BASE = nvgRGB(0x60,0x60,0x60);
 
 void configNoteBlock(Module * module, int paramIndex, bool firstBlock);
 
-int getNoteIndexForPulse(int blockType, int pulseInBlock);
-
-void getNoteAndBlock(Module* module, int baseParamIndex, int pulse, int & block, int & noteIndex);
-
-void getOuputValues(Module* module, int baseParamIndex, int pulse, float& cv, bool& updateCV, bool& gateHigh);
-
-void getNextNote(Module* module, int baseParamIndex, int& block, int& noteIndex);
-
-enum NoteExtra{
-	NE_NONE,
-	NE_MUTE,
-	NE_TIE,
-};
-
-const int SubDiv_Quarter = 1;
-const int SubDiv_Eighth = 2;
-const int SubDiv_Quarter_Quarter_Half = 3;
-const int SubDiv_Quarter_Half_Quarter = 4;
-const int SubDiv_Half_Quarter_Quarter = 5;
-const int SubDiv_Tipplets = 6;
-const int SubDiv_Sixteenth = 7;
-
 struct NoteControler {
 	virtual float getValue(){ return 0; }
 	virtual void setValue(float value){}
@@ -131,6 +108,20 @@ struct NoteExtraButton : SvgWidget {
 
 struct NoteEntryWidget : LedDisplay, NoteControler {
 	bool inMenu;
+	//The keys only change look when the selected value does, so they are drawn into a framebuffer
+	//that is redrawn on selection change rather than every frame
+	widget::FramebufferWidget* keyCache = NULL;
+	float cachedValue = NAN;
+	void step() override {
+		if(keyCache){
+			float value = getValue();
+			if(value != cachedValue){
+				cachedValue = value;
+				keyCache->setDirty();
+			}
+		}
+		LedDisplay::step();
+	}
 	void init() {
 		float margin;
 		if(inMenu){
@@ -197,6 +188,13 @@ struct NoteEntryWidget : LedDisplay, NoteControler {
 			addChild(tie);
 		}
 
+		//Padded so the margins of the outer keys aren't clipped by the framebuffer
+		Vec keyPadding = mm2px(Vec(margin, margin));
+		keyCache = new widget::FramebufferWidget;
+		keyCache->box.pos = keyPadding.neg();
+		keyCache->box.size = box.size + keyPadding.mult(2);
+		addChild(keyCache);
+
 		// White notes
 		for (int octave = 0; octave < 3; octave++){			
 			static const std::vector<int> whiteNotes = {1, 3, 5, 6, 8, 10, 12};
@@ -210,7 +208,8 @@ struct NoteEntryWidget : LedDisplay, NoteControler {
 				button->value = 3 - (note / 12.f + (octave+1)) - ROOT_OFFSET;
 				button->parent = this;
 				button->isWhite = true;
-				addChild(button);
+				button->box.pos = button->box.pos.plus(keyPadding);
+				keyCache->addChild(button);
 			}
 		}
 		// Black notes
@@ -226,7 +225,8 @@ struct NoteEntryWidget : LedDisplay, NoteControler {
 				button->value = 3 - (note / 12.f + (octave+1)) - ROOT_OFFSET;
 				button->parent = this;
 				button->isWhite = false;
-				addChild(button);
+				button->box.pos = button->box.pos.plus(keyPadding);
+				keyCache->addChild(button);
 			}
 		}
 	}
@@ -255,6 +255,20 @@ struct NoteEntryWidgetMenu : NoteEntryWidget{
 
 };
 
+//One keyboard popup per module widget. It is moved into each note's menu and pointed at that note,
+//so the buttons and SVG handles are only built once.
+struct NoteMenuPool{
+	NoteEntryWidgetMenu* keyboard = NULL;
+	~NoteMenuPool();
+	NoteEntryWidgetMenu* take(NoteControler* target);
+};
+
+//Gives the pooled keyboard back to the pool instead of deleting it with the rest of the menu
+struct PooledKeyboardMenu : ui::Menu{
+	NoteMenuPool* pool = NULL; //Cleared when the keyboard moves on or the pool goes first
+	~PooledKeyboardMenu();
+};
+
 struct NoteEntryWidgetPanel : NoteEntryWidget{
 	float value;
 	NoteExtra extra;
@@ -285,7 +299,11 @@ struct NoteEntryWidgetPanel : NoteEntryWidget{
 				lastNoteIndex = -1;
 			}else{
 				if(module){
-					getNextNote(module,baseParamIndex,lastBlockIndex,lastNoteIndex);
+					NoteBlockPattern pattern;
+					readNoteBlockPattern(module,baseParamIndex,CORE_MAX_BLOCKS,pattern);
+					getNextNote(pattern,lastBlockIndex,lastNoteIndex);
+					//Wrap around rather than writing past the last block
+					if(lastBlockIndex >= pattern.blockCount) lastBlockIndex = 0;
 					module->params[baseParamIndex + lastBlockIndex * NOTE_BLOCK_PARAM_COUNT + 1 + lastNoteIndex * 2].setValue(value);
 					module->params[baseParamIndex + lastBlockIndex * NOTE_BLOCK_PARAM_COUNT + 2 + lastNoteIndex * 2].setValue(extra);
 				}
@@ -317,15 +335,18 @@ struct PassThroughMenuOverlay : ui::MenuOverlay {
 
 struct NoteBlockWidgetParent{
 	virtual void updateDisplay();
+	//Defers updateDisplay to the next step so many param changes in one frame cost one refresh
+	virtual void markDirty(){};
 };
 
 struct TrimpotRingLight : widget::SvgWidget {
 	NVGcolor color;
+	bool batched = false; //Drawn by a RingLightBatch instead
 	TrimpotRingLight() {
 		this->box.size = mm2px(math::Vec(8.0, 8.0));
 	}
 	void drawLayer(const DrawArgs& args, int layer) override{
-		if(layer == 1 && this->color.a > 0.0) {
+		if(layer == 1 && !batched && this->color.a > 0.0) {
 			nvgBeginPath(args.vg);
 
 			float radiusA = std::min(this->box.size.x, this->box.size.y) / 2.0;
@@ -374,7 +395,7 @@ struct CustomTrimpot : app::SvgKnob{
 		// bg->box.size = ringSize;
 	}
 	void onChange(const ChangeEvent& e) override {
-		parent->updateDisplay();
+		parent->markDirty();
 		SvgKnob::onChange(e);
 	}	
 	void setColor(NVGcolor color){
@@ -382,6 +403,13 @@ struct CustomTrimpot : app::SvgKnob{
 	}
 };
 
+//Mute and tie icons shared by every NoteWidget, loaded on first use
+struct NoteExtraSvgs{
+	std::shared_ptr<window::Svg> mute;
+	std::shared_ptr<window::Svg> tie;
+};
+const NoteExtraSvgs & noteExtraSvgs();
+
 struct NoteWidget : widget::OpaqueWidget, NoteControler {
 	NoteBlockWidgetParent * parent = NULL;
 	NoteEntryWidgetPanel * panelSetter = NULL;
@@ -389,10 +417,11 @@ struct NoteWidget : widget::OpaqueWidget, NoteControler {
 	bool canTie;
 	CustomTrimpot* knob = NULL;
 	ColoredSvgWidget* extra = NULL;
-	std::shared_ptr<window::Svg> mute;
-	std::shared_ptr<window::Svg> tie;
+	NoteExtra shownExtra = NE_NONE; //Which icon extra holds, so the svg is only swapped when it changes
 	int noteIndex;
 	int blockIndex;
+	int timingParamId = -1; //Microtiming param, -1 when the module has none
+	NoteMenuPool* menuPool = NULL;
 	NoteWidget() {
 	}
 	void init(NoteBlockWidgetParent* parent, Module* module, int paramId, int blockIndex, int noteIndex){
@@ -414,9 +443,6 @@ struct NoteWidget : widget::OpaqueWidget, NoteControler {
 		extra->color = COLOR_MARGIN;
 		addChild(extra);
 
-		mute = Svg::load(asset::plugin(pluginInstance,"res/mute_off.svg"));
-		tie = Svg::load(asset::plugin(pluginInstance,"res/tie_off.svg"));
-
 		box = knob->box;
 	}
 	void setColor(NVGcolor color){
@@ -470,7 +496,7 @@ struct NoteWidget : widget::OpaqueWidget, NoteControler {
 	bool setExtra(NoteExtra value) override{
 		if(!canTie && value==NE_TIE) return false; 
 		knob->module->paramQuantities[knob->paramId + 1]->setValue(value);
-		parent->updateDisplay();
+		parent->markDirty();
 		return true;
 	}
 	//void onHoverScroll(const HoverScrollEvent& e) override;
@@ -478,7 +504,13 @@ struct NoteWidget : widget::OpaqueWidget, NoteControler {
 		//Pulled from helper.hpp : createMenu
 		Menu* menu;
 		{
-			menu = new Menu;
+			if(menuPool){
+				PooledKeyboardMenu* pooledMenu = new PooledKeyboardMenu;
+				pooledMenu->pool = menuPool;
+				menu = pooledMenu;
+			}else{
+				menu = new Menu;
+			}
 			menu->box.pos = APP->scene->mousePos - mm2px(Vec(158.88f/2.f*1.5f,0)); //Add offset to move the menu into the middle of the click position
 
 			ui::MenuOverlay* menuOverlay = new PassThroughMenuOverlay;
@@ -486,52 +518,96 @@ struct NoteWidget : widget::OpaqueWidget, NoteControler {
 
 			APP->scene->addChild(menuOverlay);
 		}
-		NoteEntryWidgetMenu* noteSelector = createWidget<NoteEntryWidgetMenu>(mm2px(Vec(0, 0)));
-		noteSelector->parent = this; 
-		noteSelector->init();
+		NoteEntryWidgetMenu* noteSelector;
+		if(menuPool){
+			noteSelector = menuPool->take(this);
+		}else{
+			noteSelector = createWidget<NoteEntryWidgetMenu>(mm2px(Vec(0, 0)));
+			noteSelector->parent = this; 
+			noteSelector->init();
+		}
 		menu->addChild(noteSelector);
+
+		if(timingParamId >= 0 && knob->module != NULL){
+			ui::Slider* timing = new ui::Slider;
+			timing->quantity = knob->module->paramQuantities[timingParamId];
+			timing->box.size.x = noteSelector->box.size.x;
+			menu->addChild(timing);
+		}
 	}	
+	NoteExtra getExtraValue(){
+		if(knob->module == NULL) return NE_NONE;
+		return static_cast<NoteExtra>(knob->module->paramQuantities[knob->paramId + 1]->getValue());
+	}
+	//Points extra at the icon for value, only touching the svg when the extra changed
+	void showExtra(NoteExtra value){
+		if(value == shownExtra) return;
+		shownExtra = value;
+		if(value == NE_MUTE) extra->setSvg(noteExtraSvgs().mute);
+		if(value == NE_TIE) extra->setSvg(noteExtraSvgs().tie);
+	}
+	//True when the knob and its ring are showing rather than a mute or tie
+	bool showsKnob(){
+		if(!displayed || !isVisible()) return false;
+		return getExtraValue() == NE_NONE;
+	}
 	void draw(const DrawArgs& args) override {		
 		if(displayed){
-			NoteExtra extraValue = NE_NONE;
-			if(knob->module != NULL) extraValue = static_cast<NoteExtra>(knob->module->paramQuantities[knob->paramId + 1]->getValue());
-			switch(extraValue){
-				case NE_NONE:
-					knob->draw(args);
-					break;
-				case NE_MUTE:
-					extra->setSvg(mute);
-					extra->draw(args);
-					break;
-				case NE_TIE:
-					extra->setSvg(tie);
-					extra->draw(args);
-					break;
+			NoteExtra extraValue = getExtraValue();
+			if(extraValue == NE_NONE){
+				knob->draw(args);
+			}else{
+				showExtra(extraValue);
+				extra->draw(args);
 			}
 		}
 	}
 	void drawLayer(const DrawArgs& args, int layer) override {		
 		if(displayed){
-			NoteExtra extraValue = NE_NONE;
-			if(knob->module != NULL) extraValue = static_cast<NoteExtra>(knob->module->paramQuantities[knob->paramId + 1]->getValue());
-			switch(extraValue){
-				case NE_NONE:
-					knob->drawLayer(args,layer);
-					break;
-				case NE_MUTE:
-					extra->setSvg(mute);
-					extra->drawLayer(args,layer);
-					break;
-				case NE_TIE:
-					extra->setSvg(tie);
-					extra->drawLayer(args,layer);
-					break;
+			NoteExtra extraValue = getExtraValue();
+			if(extraValue == NE_NONE){
+				knob->drawLayer(args,layer);
+			}else{
+				showExtra(extraValue);
+				extra->drawLayer(args,layer);
 			}
 		}
 	}
 };
 
 
+//Draws the ring lights of many notes on the light layer with one path per color, instead of two per knob.
+//Optionally leaves a fading trail behind recently played notes, quantized so trails batch as well.
+struct RingLightBatch : widget::TransparentWidget {
+	struct Ring{
+		NoteWidget* note;
+		float trail = 0; //1 while lit, fades to 0 once the ring goes dark
+		NVGcolor trailColor;
+	};
+	struct ColorGroup{
+		NVGcolor color;
+		std::vector<math::Vec> centers; //Kept between frames so drawing doesn't allocate
+	};
+	static constexpr float TRAIL_TIME = 0.5f; //Seconds for a trail to fade out, whatever the frame rate
+	static constexpr int TRAIL_LEVELS = 8;
+
+	std::vector<Ring> rings;
+	std::vector<ColorGroup> groups;
+	size_t groupCount = 0;
+	bool trails = false;
+
+	void addNote(NoteWidget* note){
+		Ring ring;
+		ring.note = note;
+		ring.trailColor = COLOR_TRANSPARENT;
+		rings.push_back(ring);
+		note->knob->ring->batched = true;
+	}
+
+	void step() override;
+	void drawLayer(const DrawArgs& args, int layer) override;
+};
+
 struct SubdivisionWidget : app::Switch
 {
 	struct Frame{
@@ -700,8 +776,8 @@ struct SubdivisionWidget : app::Switch
 	}
 
 	void setColor(int i, NVGcolor color){
+		//Note lights draw on the light layer outside the framebuffer, so the cached panel stays clean
 		noteLights[i]->color = color;
-		fb->dirty = true;
 	}
 
 	void addFrame(int key, Frame frame) {
@@ -715,7 +791,7 @@ struct SubdivisionWidget : app::Switch
 	}
 
 	void onChange(const ChangeEvent& e) override {
-		parent->updateDisplay();
+		parent->markDirty();
 		ParamWidget::onChange(e);
 	}
 
@@ -789,7 +865,7 @@ struct SubdivisionWidget : app::Switch
 struct NoteBlockWidget : widget::Widget, NoteBlockWidgetParent{
 	SubdivisionWidget* subdivWidget;
 	NoteWidget* noteWidget[4];
-	void init(Module * module, NoteEntryWidgetPanel * panelSetter, int index, int paramIndex){		
+	void init(Module * module, NoteEntryWidgetPanel * panelSetter, int index, int paramIndex, int timingParamIndex = -1, NoteMenuPool* menuPool = NULL){		
 		subdivWidget = createParam<SubdivisionWidget>(mm2px(Vec(0,12)), module, paramIndex);
 		subdivWidget->index = index;
 		subdivWidget->parent = this;
@@ -800,6 +876,8 @@ struct NoteBlockWidget : widget::Widget, NoteBlockWidgetParent{
 			noteWidget[i]->init(this, module, paramIndex + 1 + i * 2, index, i);
 			noteWidget[i]->panelSetter = panelSetter;
 			noteWidget[i]->canTie = i == 0 && index != 0;
+			if(timingParamIndex >= 0) noteWidget[i]->timingParamId = timingParamIndex + i;
+			noteWidget[i]->menuPool = menuPool;
 			this->addChild(noteWidget[i]);
 		}
 
@@ -809,16 +887,46 @@ struct NoteBlockWidget : widget::Widget, NoteBlockWidgetParent{
 	}
 
 	int subdiv = 1; //Notes
+	float prevExtra[4] = {-1,-1,-1,-1};
+	bool displayDirty = false;
+	float heat = 0; //How much this block has played lately, 0 to 1 relative to the others
 
 	void step() override {
-		if(subdivWidget->module != NULL){
+		Module* module = subdivWidget->module;
+		if(module != NULL){
 			int newSubdiv = static_cast<int>(subdivWidget->getParamQuantity()->getValue());
 			if(subdiv != newSubdiv){
 				subdiv = newSubdiv;
 				updateKnobs();
 			}
+			//Extras have no ParamWidget of their own, so watch them here to catch batch edits, undo and preset loads
+			for(int i = 0; i < 4; i++){
+				float extra = module->params[subdivWidget->paramId + 2 + i * 2].getValue();
+				if(prevExtra[i] != extra){
+					prevExtra[i] = extra;
+					displayDirty = true;
+				}
+			}
 		}
 		Widget::step();
+		if(displayDirty){
+			displayDirty = false;
+			updateDisplay();
+		}
+	}
+
+	void markDirty() override{
+		displayDirty = true;
+	}
+
+	void drawLayer(const DrawArgs& args, int layer) override{
+		Widget::drawLayer(args, layer);
+		if(layer != 1 || heat <= 0) return;
+		//Tint over the whole block, the knobs stay readable through it
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0, 0, subdivWidget->box.size.x, subdivWidget->box.pos.y + subdivWidget->box.size.y);
+		nvgFillColor(args.vg, nvgTransRGBAf(COLOR_ACTIVE_NOTE, heat * 0.35f));
+		nvgFill(args.vg);
 	}
 
 	void setColor(int noteIndex, NVGcolor color){
@@ -852,4 +960,107 @@ struct NoteBlockWidget : widget::Widget, NoteBlockWidgetParent{
 			noteWidget[i]->displayed = POS[subdiv][i] != GONE;
 		}
 	}
-};
\ No newline at end of file
+};
+//What a NoteBlockWidget shows without a module, for the module browser. Draws the shared svgs directly
+//instead of building the subdivision frames, knobs and menus of a real block.
+struct NoteBlockPreview : widget::Widget{
+	std::shared_ptr<window::Svg> subdiv;
+	std::shared_ptr<window::Svg> knobBg;
+	std::shared_ptr<window::Svg> knob;
+	const math::Vec KNOB_POS = mm2px(Vec(7.5,2.5)); //NoteBlockWidget's single note layout
+	const math::Vec SUBDIV_POS = mm2px(Vec(0,12));
+
+	NoteBlockPreview(){
+		subdiv = Svg::load(asset::plugin(pluginInstance,"res/subdiv/1.svg"));
+		knobBg = Svg::load(asset::system("res/ComponentLibrary/Trimpot_bg.svg"));
+		knob = Svg::load(asset::system("res/ComponentLibrary/Trimpot.svg"));
+		box.size = SUBDIV_POS.plus(subdiv->getSize());
+	}
+
+	void drawSvg(const DrawArgs& args, std::shared_ptr<window::Svg> svg, math::Vec pos){
+		nvgSave(args.vg);
+		nvgTranslate(args.vg, pos.x, pos.y);
+		window::svgDraw(args.vg, svg->handle);
+		nvgRestore(args.vg);
+	}
+
+	void draw(const DrawArgs& args) override{
+		drawSvg(args, knobBg, KNOB_POS);
+		drawSvg(args, knob, KNOB_POS);
+		drawSvg(args, subdiv, SUBDIV_POS);
+	}
+};
+
+//One block as the piano roll draws it. Compared every step so only the blocks that changed redraw.
+struct PianoRollColumnState{
+	int subdivision = 0;
+	float pitch [4] = {}; //Ties take the pitch of the note they continue
+	NoteExtra extra [4] = {NE_NONE, NE_NONE, NE_NONE, NE_NONE};
+	bool active = false; //Inside the sequence length
+
+	//The block evolution will play here instead, drawn faintly behind the notes
+	bool ghost = false;
+	int ghostSubdivision = 0;
+	float ghostPitch [4] = {};
+	NoteExtra ghostExtra [4] = {NE_NONE, NE_NONE, NE_NONE, NE_NONE};
+
+	bool operator==(const PianoRollColumnState & other) const;
+	bool operator!=(const PianoRollColumnState & other) const { return !(*this == other); }
+};
+
+struct PianoRollColumn : widget::Widget{
+	PianoRollColumnState state;
+	int index;
+
+	void draw(const DrawArgs& args) override;
+};
+
+//Pitch by pulse view of the note blocks, dragging a note up or down changes its pitch. Each block draws into its
+//own framebuffer so an edit only redraws that block, the playhead is drawn over them on the light layer.
+struct PianoRollWidget : widget::OpaqueWidget{
+	Module* module = NULL;
+	int baseParamIndex;
+	widget::FramebufferWidget* columnCache [CORE_MAX_BLOCKS];
+	PianoRollColumn* columns [CORE_MAX_BLOCKS];
+
+	//Set by the owner every step
+	int blockCount = CORE_MAX_BLOCKS;
+	int playPulse = -1;
+	int evolvedPulse = -1; //Pulse the playhead is borrowed from by evolution, -1 when playing in place
+	int ghostBlock [CORE_MAX_BLOCKS]; //Block evolution plays in each block's place next, -1 for none
+
+	int dragParamId = -1;
+	float dragStartCV;
+	float dragY;
+
+	PianoRollWidget(){
+		for(int bi = 0; bi < CORE_MAX_BLOCKS; bi++) ghostBlock[bi] = -1;
+	}
+
+	//box must be sized first, the columns split it evenly
+	void init(Module* module, int baseParamIndex);
+
+	static int pitchRows();
+	static float pitchToY(float cv, float height);
+	//Fills the pitch and extra of each note in play order, ties take prevPitch which is left on the last note sounded
+	static void columnNotes(const NoteBlock & block, float & prevPitch, float* pitch, NoteExtra* extra);
+
+	void step() override;
+	void drawLayer(const DrawArgs& args, int layer) override;
+	void onButton(const ButtonEvent& e) override;
+	void onDragMove(const DragMoveEvent& e) override;
+	void onDragEnd(const DragEndEvent& e) override;
+};
+
+//Last few bars of the CV and gate outputs, read from the module's ScopeRing each frame. More pulses than
+//pixels are decimated to min/max per column so the trace keeps its peaks.
+struct OutputScopeWidget : widget::Widget{
+	const ScopeRing* ring = NULL;
+	ScopeSample samples [SCOPE_PULSES];
+	float columnMin [SCOPE_PULSES];
+	float columnMax [SCOPE_PULSES];
+	bool columnGate [SCOPE_PULSES];
+
+	void draw(const DrawArgs& args) override;
+	void drawLayer(const DrawArgs& args, int layer) override;
+};